@@ -0,0 +1,98 @@
+// Connection storm against a listener shared by every shard of a group:
+// how fast connections are accepted, and how many wakeups it takes.
+//
+// usage: accept-benchmark [shards] [connections] [burst size]
+#include <cppevents/event_queue_group.hpp>
+#include <cppevents/network.hpp>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+int main(int argc, char* argv[])
+{
+    const std::size_t shard_count = argc > 1 ? std::atoi(argv[1]) : 4;
+    const int connections = argc > 2 ? std::atoi(argv[2]) : 10'000;
+    const int burst = argc > 3 ? std::atoi(argv[3]) : 500;
+
+    int listener = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    socklen_t length = sizeof(address);
+    if (::bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0
+        || ::listen(listener, 4096) != 0
+        || ::getsockname(listener, reinterpret_cast<sockaddr*>(&address), &length) != 0)
+    {
+        std::cerr << "ERROR: could not listen on the loopback\n";
+        return 1;
+    }
+
+    cppevents::event_queue_group group(shard_count);
+
+    std::atomic<int> accepted = 0;
+    group.on_event<cppevents::network_event>([&](const cppevents::network_event& ev) {
+        if (ev.type != cppevents::network_event::new_connection)
+            return;
+
+        ::close(ev.sock_handle);
+        accepted.fetch_add(1, std::memory_order_relaxed);
+    });
+
+    std::vector<uint64_t> polls_before(group.size());
+    for (std::size_t i = 0; i < group.size(); ++i)
+    {
+        if (group.run_on(i, [&] { return cppevents::add_source<cppevents::socket_listener>(listener, group.shard(i)); })
+            != cppevents::error_code::success)
+        {
+            std::cerr << "ERROR: could not add the listener\n";
+            return 1;
+        }
+
+        polls_before[i] = group.run_on(i, [&] { return group.shard(i).statistics().poll_calls; });
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<int> clients;
+    for (int sent = 0; sent < connections; )
+    {
+        // completed by the kernel into the backlog, nothing to wait for
+        for (int i = 0; i < burst && sent < connections; ++i, ++sent)
+        {
+            int client = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            ::connect(client, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+            clients.push_back(client);
+        }
+
+        while (accepted.load(std::memory_order_relaxed) < sent)
+            std::this_thread::yield();
+
+        for (int client : clients)
+            ::close(client);
+        clients.clear();
+    }
+
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+
+    uint64_t polls = 0;
+    for (std::size_t i = 0; i < group.size(); ++i)
+        polls += group.run_on(i, [&] { return group.shard(i).statistics().poll_calls; }) - polls_before[i];
+
+    // every shard was woken for run_on above, those are not counted out
+    std::cout << group.size() << " shards: " << connections / elapsed.count() / 1e3 << " k connections/s, "
+              << polls << " wakeups for " << connections << " connections\n";
+
+    group.stop();
+    ::close(listener);
+}
@@ -0,0 +1,125 @@
+// Cost of waiting on many ready descriptors, built once per polling
+// backend so the results can be compared side by side
+//
+// usage: backend-benchmark-<backend> [rounds] [fd counts...]
+//
+// 100k descriptors need RLIMIT_NOFILE raised accordingly
+#include <cppevents/event_queue.hpp>
+
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+struct ready_event
+{
+    int fd;
+};
+
+static cppevents::raw_event read_ready(int fd)
+{
+    eventfd_t value;
+    if (eventfd_read(fd, &value) != 0)
+        return cppevents::empty_event{};
+
+    return ready_event{fd};
+}
+
+// edge triggered eventfds report every write, so the counter can be left
+// alone and only the cost of the queue itself is measured
+static cppevents::raw_event skip_read(int fd)
+{
+    return ready_event{fd};
+}
+
+static bool raise_fd_limit(std::size_t fds)
+{
+    rlimit limit{};
+    getrlimit(RLIMIT_NOFILE, &limit);
+
+    if (limit.rlim_cur >= fds)
+        return true;
+
+    limit.rlim_cur = std::min<rlim_t>(limit.rlim_max, fds);
+    setrlimit(RLIMIT_NOFILE, &limit);
+
+    return limit.rlim_cur >= fds;
+}
+
+static void run(std::size_t fd_count, int rounds, cppevents::trigger_mode mode, bool read = true)
+{
+    if (not raise_fd_limit(fd_count + 64))
+    {
+        std::cout << fd_count << " fds: skipped, RLIMIT_NOFILE too low\n";
+        return;
+    }
+
+    cppevents::event_queue queue;
+    queue.set_batch_size(64, 1024);
+
+    uint64_t handled = 0;
+    cppevents::on_event<ready_event>([&](ready_event&) { handled++; }, queue);
+
+    std::vector<int> fds;
+    for (std::size_t i = 0; i < fd_count; ++i)
+    {
+        int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (fd < 0 || queue.add_native_source(fd, read ? &read_ready : &skip_read, nullptr, mode) != cppevents::error_code::success)
+        {
+            std::cout << fd_count << " fds: could not register descriptor " << i << "\n";
+            return;
+        }
+        fds.push_back(fd);
+    }
+
+    std::chrono::duration<double> waiting{};
+    uint64_t before = queue.statistics().poll_calls;
+
+    for (int round = 0; round < rounds; ++round)
+    {
+        // every descriptor becomes ready, only the draining is timed
+        for (int fd : fds)
+            eventfd_write(fd, 1);
+
+        handled = 0;
+        auto start = std::chrono::steady_clock::now();
+        while (handled < fd_count)
+            queue.wait();
+        waiting += std::chrono::steady_clock::now() - start;
+    }
+
+    const double events = double(fd_count) * rounds;
+    const uint64_t poll_calls = queue.statistics().poll_calls - before;
+
+    const char* label = mode == cppevents::trigger_mode::level ? "level" : read ? "edge " : "edge, no reads";
+
+    std::cout << fd_count << " fds, " << label << ": "
+              << waiting.count() * 1e9 / events << " ns/event, "
+              << events / waiting.count() / 1e6 << " M events/s, "
+              << poll_calls / double(rounds) << " polling syscalls per round\n";
+
+    for (int fd : fds)
+        close(fd);
+}
+
+int main(int argc, char* argv[])
+{
+    const int rounds = argc > 1 ? std::atoi(argv[1]) : 20;
+
+    std::vector<std::size_t> counts;
+    for (int i = 2; i < argc; ++i)
+        counts.push_back(std::atoi(argv[i]));
+    if (counts.empty())
+        counts = { 1'000, 10'000, 100'000 };
+
+    for (std::size_t count : counts)
+    {
+        run(count, rounds, cppevents::trigger_mode::level);
+        run(count, rounds, cppevents::trigger_mode::edge);
+        run(count, rounds, cppevents::trigger_mode::edge, false);
+    }
+}
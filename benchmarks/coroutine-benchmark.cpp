@@ -0,0 +1,142 @@
+// Request/response over a socket pair, the client written as a coroutine
+// and as the equivalent callback state machine.  The echo side is the
+// same plain native source in both.
+//
+// usage: coroutine-benchmark [round trips]
+#include <cppevents/coroutine.hpp>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+
+struct request
+{
+    int fd;
+    uint64_t value;
+};
+
+struct response
+{
+    uint64_t value;
+};
+
+static cppevents::raw_event read_request(int fd)
+{
+    uint64_t value;
+    if (read(fd, &value, sizeof(value)) != sizeof(value))
+        return cppevents::empty_event{};
+
+    return request{fd, value};
+}
+
+static cppevents::raw_event read_response(int fd)
+{
+    uint64_t value;
+    if (read(fd, &value, sizeof(value)) != sizeof(value))
+        return cppevents::empty_event{};
+
+    return response{value};
+}
+
+static void write_value(int fd, uint64_t value)
+{
+    if (write(fd, &value, sizeof(value)) != sizeof(value))
+        std::cerr << "ERROR: write failed\n";
+}
+
+static bool open_pair(cppevents::event_queue& queue, int sv[2])
+{
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, sv) != 0)
+        return false;
+
+    // echo side, answers every request with the value plus one
+    cppevents::on_event<request>([](request& req) { write_value(req.fd, req.value + 1); }, queue);
+    return queue.add_native_source(sv[1], &read_request) == cppevents::error_code::success;
+}
+
+static cppevents::task coroutine_client(cppevents::event_queue& queue, int fd, uint64_t round_trips, bool& done)
+{
+    uint64_t value = 0;
+
+    for (uint64_t i = 0; i < round_trips; ++i)
+    {
+        write_value(fd, value);
+
+        if (co_await cppevents::readable(fd, queue) != cppevents::error_code::success)
+            break;
+
+        if (read(fd, &value, sizeof(value)) != sizeof(value))
+            break;
+    }
+
+    done = true;
+}
+
+static double run_coroutines(uint64_t round_trips)
+{
+    cppevents::event_queue queue;
+
+    int sv[2];
+    if (not open_pair(queue, sv))
+        return 0.0;
+
+    bool done = false;
+    auto start = std::chrono::steady_clock::now();
+
+    coroutine_client(queue, sv[0], round_trips, done);
+    while (not done)
+        queue.wait();
+
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+
+    queue.remove_native_source(sv[0]);
+    close(sv[0]);
+    close(sv[1]);
+
+    return round_trips / elapsed.count();
+}
+
+static double run_callbacks(uint64_t round_trips)
+{
+    cppevents::event_queue queue;
+
+    int sv[2];
+    if (not open_pair(queue, sv))
+        return 0.0;
+
+    // the loop of the coroutine, turned inside out
+    uint64_t completed = 0;
+    cppevents::on_event<response>([&](response& res) {
+        if (++completed < round_trips)
+            write_value(sv[0], res.value);
+    }, queue);
+    queue.add_native_source(sv[0], &read_response);
+
+    auto start = std::chrono::steady_clock::now();
+
+    write_value(sv[0], 0);
+    while (completed < round_trips)
+        queue.wait();
+
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+
+    close(sv[0]);
+    close(sv[1]);
+
+    return round_trips / elapsed.count();
+}
+
+int main(int argc, char* argv[])
+{
+    const uint64_t round_trips = argc > 1 ? std::atoll(argv[1]) : 200'000;
+
+    const double callbacks = run_callbacks(round_trips);
+    const double coroutines = run_coroutines(round_trips);
+
+    std::cout << "callbacks:  " << callbacks / 1e3 << " k round trips/s\n"
+              << "coroutines: " << coroutines / 1e3 << " k round trips/s"
+              << " (" << coroutines / callbacks << "x)\n";
+}
@@ -0,0 +1,98 @@
+// Recursive watching of a generated tree: how long setting up the
+// watches takes, and how a burst of writes turns into events.
+//
+// usage: filesystem-benchmark [directories] [files per directory] [writes per file] [inotify|fanotify]
+#include <cppevents/filesystem.hpp>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <string>
+
+int main(int argc, char* argv[])
+{
+    using namespace std::chrono_literals;
+
+    const int directories = argc > 1 ? std::atoi(argv[1]) : 2'000;
+    const int files = argc > 2 ? std::atoi(argv[2]) : 20;
+    const int writes = argc > 3 ? std::atoi(argv[3]) : 10;
+    const auto backend = argc > 4 && std::string(argv[4]) == "fanotify" ? cppevents::filesystem_backend::fanotify
+                                                                         : cppevents::filesystem_backend::inotify;
+
+    const std::filesystem::path root = std::filesystem::temp_directory_path() / "cppevents-filesystem-benchmark";
+    std::filesystem::remove_all(root);
+
+    // two levels, so that there is some depth to walk
+    std::vector<std::string> paths;
+    for (int d = 0; d < directories; ++d)
+    {
+        auto dir = root / std::to_string(d % 64) / std::to_string(d);
+        std::filesystem::create_directories(dir);
+
+        for (int f = 0; f < files; ++f)
+            paths.push_back(dir / ("file" + std::to_string(f)));
+    }
+
+    for (const std::string& path : paths)
+        ::close(::open(path.c_str(), O_CREAT | O_WRONLY | O_CLOEXEC, 0644));
+
+    cppevents::event_queue queue;
+    cppevents::filesystem_watcher watcher(queue, backend);
+
+    uint64_t events = 0;
+    uint64_t overflows = 0;
+    cppevents::on_event<cppevents::filesystem_event>([&](const cppevents::filesystem_event& ev) {
+        events++;
+        if (ev.changes & cppevents::filesystem_event::overflow)
+            overflows++;
+    }, queue);
+
+    auto start = std::chrono::steady_clock::now();
+    if (watcher.watch(root.native()) != cppevents::error_code::success)
+    {
+        std::cerr << "ERROR: could not watch " << root << "\n";
+        return 1;
+    }
+    auto setup = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start);
+
+    // every file written several times, each write is an IN_MODIFY
+    for (const std::string& path : paths)
+    {
+        int fd = ::open(path.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+        for (int i = 0; i < writes; ++i)
+            if (::write(fd, "x", 1) != 1)
+                break;
+        ::close(fd);
+    }
+
+    const uint64_t polls_before = queue.statistics().poll_calls;
+
+    // until things go quiet, events may have been lost to an overflow
+    start = std::chrono::steady_clock::now();
+    auto last_event = start;
+    for (uint64_t seen = 0; std::chrono::steady_clock::now() - last_event < 100ms; )
+    {
+        queue.wait(10ms);
+        if (events != seen)
+        {
+            seen = events;
+            last_event = std::chrono::steady_clock::now();
+        }
+    }
+    auto handling = std::chrono::duration<double, std::milli>(last_event - start);
+
+    const uint64_t polls = queue.statistics().poll_calls - polls_before;
+
+    std::cout << (watcher.backend() == cppevents::filesystem_backend::fanotify ? "fanotify: " : "inotify: ")
+              << watcher.size() << " watches, " << paths.size() << " files\n"
+              << "watch:   " << setup.count() << " ms\n"
+              << "writes:  " << paths.size() * writes << " -> " << events << " events in "
+              << polls << " wakeups, " << handling.count() << " ms, "
+              << overflows << " overflows\n";
+
+    std::filesystem::remove_all(root);
+}
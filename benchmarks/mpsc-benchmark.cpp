@@ -0,0 +1,70 @@
+// Cross-thread send_event throughput, N producers and one queue thread
+//
+// usage: mpsc-benchmark [producers] [events per producer]
+#include <cppevents/event_queue.hpp>
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+struct work_item
+{
+    uint32_t producer;
+    uint32_t sequence;
+};
+
+int main(int argc, char* argv[])
+{
+    const uint32_t producers = argc > 1 ? std::atoi(argv[1]) : 4;
+    const uint32_t events_per_producer = argc > 2 ? std::atoi(argv[2]) : 1'000'000;
+    const uint64_t total = uint64_t(producers) * events_per_producer;
+
+    cppevents::event_queue queue;
+
+    uint64_t received = 0;
+    std::vector<uint32_t> next_expected(producers, 0);
+    bool in_order = true;
+
+    cppevents::on_event<work_item>([&](const work_item& item) {
+        in_order &= next_expected[item.producer] == item.sequence;
+        next_expected[item.producer] = item.sequence + 1;
+        received++;
+    }, queue);
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> threads;
+    for (uint32_t p = 0; p < producers; ++p)
+    {
+        threads.emplace_back([&queue, p, events_per_producer] {
+            for (uint32_t i = 0; i < events_per_producer; ++i)
+                queue.send_event(work_item{p, i});
+        });
+    }
+
+    uint64_t loop_iterations = 0;
+    while (received < total)
+    {
+        queue.wait();
+        loop_iterations++;
+    }
+
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+
+    for (auto& t : threads)
+        t.join();
+
+    cppevents::queue_statistics stats = queue.statistics();
+
+    std::cout << producers << " producers, " << total << " events in " << elapsed.count() << "s\n"
+              << "  throughput:      " << total / elapsed.count() / 1e6 << " M events/s\n"
+              << "  loop iterations: " << loop_iterations << "\n"
+              << "  eventfd writes:  " << stats.remote_wakeups << "\n"
+              << "  wakeups avoided: " << stats.remote_events - stats.remote_wakeups
+              << " (" << 100.0 * (stats.remote_events - stats.remote_wakeups) / stats.remote_events << "%)\n"
+              << "  per-producer order " << (in_order ? "kept" : "BROKEN") << "\n";
+
+    return in_order ? 0 : 1;
+}
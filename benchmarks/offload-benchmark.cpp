@@ -0,0 +1,102 @@
+// Latency of fast events while slow handlers are running, with handlers
+// run inline on the queue thread and offloaded to an executor
+//
+// usage: offload-benchmark [workers] [fast events] [slow handler ms]
+#include <cppevents/executor.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using clock_type = std::chrono::steady_clock;
+
+struct fast_event
+{
+    uint32_t sequence;
+    clock_type::time_point sent;
+};
+
+struct slow_event
+{
+    clock_type::time_point sent;
+};
+
+struct done_event {};
+
+static void report(const char* name, std::vector<double>& latency)
+{
+    std::sort(latency.begin(), latency.end());
+
+    auto at = [&](double fraction) { return latency[std::size_t(fraction * (latency.size() - 1))]; };
+
+    std::cout << name << ": fast event latency"
+              << "  p50 " << at(0.50) << "us"
+              << "  p99 " << at(0.99) << "us"
+              << "  max " << latency.back() << "us\n";
+}
+
+static void run(cppevents::executor* workers, uint32_t fast_events, std::chrono::milliseconds slow_time)
+{
+    cppevents::event_queue queue;
+    std::vector<double> latency(fast_events);
+    std::atomic<uint32_t> handled = 0;
+    bool done = false;
+
+    auto fast = [&](fast_event& ev) {
+        latency[ev.sequence] = std::chrono::duration<double, std::micro>(clock_type::now() - ev.sent).count();
+        handled.fetch_add(1, std::memory_order_release);
+    };
+    auto slow = [slow_time](slow_event&) {
+        auto until = clock_type::now() + slow_time;
+        while (clock_type::now() < until);
+    };
+
+    if (workers != nullptr) {
+        cppevents::on_event<fast_event>(fast, cppevents::offload{*workers}, queue);
+        cppevents::on_event<slow_event>(slow, cppevents::offload{*workers}, queue);
+    } else {
+        cppevents::on_event<fast_event>(fast, queue);
+        cppevents::on_event<slow_event>(slow, queue);
+    }
+    cppevents::on_event<done_event>([&](done_event&) { done = true; }, queue);
+
+    std::thread producer([&] {
+        for (uint32_t i = 0; i < fast_events; ++i)
+        {
+            if (i % 100 == 0)
+                queue.send_event(slow_event{clock_type::now()});
+
+            queue.send_event(fast_event{i, clock_type::now()});
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+        queue.send_event(done_event{});
+    });
+
+    while (not done)
+        queue.wait();
+
+    producer.join();
+
+    while (handled.load(std::memory_order_acquire) < fast_events)
+        std::this_thread::yield();
+
+    report(workers != nullptr ? "offloaded" : "inline   ", latency);
+}
+
+int main(int argc, char* argv[])
+{
+    const std::size_t worker_count = argc > 1 ? std::atoi(argv[1]) : 4;
+    const uint32_t fast_events = argc > 2 ? std::atoi(argv[2]) : 10'000;
+    const std::chrono::milliseconds slow_time(argc > 3 ? std::atoi(argv[3]) : 5);
+
+    run(nullptr, fast_events, slow_time);
+
+    cppevents::executor workers(worker_count);
+    run(&workers, fast_events, slow_time);
+
+    std::cout << "  steals: " << workers.steals() << "\n";
+}
@@ -0,0 +1,87 @@
+// Stream data over socket pairs into socket_io_event sources, and check
+// that receiving stops taking memory once the buffer pool has grown.
+//
+// usage: receive-benchmark [sockets] [megabytes] [message size]
+#include <cppevents/network.hpp>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+int main(int argc, char* argv[])
+{
+    const int sockets = argc > 1 ? std::atoi(argv[1]) : 64;
+    const std::size_t total = (argc > 2 ? std::atoll(argv[2]) : 1024) << 20;
+    const std::size_t message = argc > 3 ? std::atoll(argv[3]) : 4096;
+
+    cppevents::event_queue queue;
+
+    std::vector<int> writers;
+    for (int i = 0; i < sockets; ++i)
+    {
+        int sv[2];
+        if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) != 0)
+        {
+            std::cerr << "ERROR: socketpair failed\n";
+            return 1;
+        }
+
+        cppevents::add_source<cppevents::socket_io_event>(sv[0], queue);
+        writers.push_back(sv[1]);
+    }
+
+    std::size_t received = 0;
+    uint64_t checksum = 0;
+    cppevents::on_event<cppevents::network_event>([&](const cppevents::network_event& ev) {
+        if (ev.type != cppevents::network_event::data_received)
+            return;
+
+        received += ev.data.size();
+        checksum += static_cast<uint64_t>(ev.data.front()) + static_cast<uint64_t>(ev.data.back());
+    }, queue);
+
+    std::thread writer([&] {
+        std::vector<char> data(message, 'x');
+        for (std::size_t sent = 0; sent < total; sent += message)
+            if (::write(writers[(sent / message) % writers.size()], data.data(), message) != static_cast<ssize_t>(message))
+                break;
+    });
+
+    // warmed up after the first tenth, the pool has grown by then
+    cppevents::queue_statistics warm{};
+    bool warmed = false;
+
+    auto start = std::chrono::steady_clock::now();
+    while (received < total)
+    {
+        queue.wait(std::chrono::milliseconds(100));
+
+        if (not warmed && received >= total / 10)
+        {
+            warm = queue.statistics();
+            warmed = true;
+        }
+    }
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+
+    writer.join();
+
+    const cppevents::queue_statistics stats = queue.statistics();
+
+    std::cout << sockets << " sockets, " << message << " byte messages: "
+              << received / elapsed.count() / (1 << 20) << " MiB/s\n"
+              << "buffers: " << stats.buffer_allocations << " taken, "
+              << stats.buffer_slab_allocations << " slabs, "
+              << stats.buffer_slab_allocations - warm.buffer_slab_allocations << " after warmup\n"
+              << "events:  " << stats.pool_slab_allocations - warm.pool_slab_allocations
+              << " pool slabs and " << stats.pool_oversize_allocations << " oversize after warmup\n";
+
+    (void)checksum;
+    for (int fd : writers)
+        ::close(fd);
+}
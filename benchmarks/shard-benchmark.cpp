@@ -0,0 +1,120 @@
+// Socket ping-pong across an event_queue_group, one round trip in flight
+// per socket pair, both ends of a pair on the same shard
+//
+// usage: shard-benchmark [max shards] [pairs per shard] [seconds per run]
+#include <cppevents/event_queue_group.hpp>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+struct ping
+{
+    int fd;
+    uint64_t value;
+};
+
+struct alignas(64) pair_state
+{
+    int peer = -1;
+    uint64_t round_trips = 0;
+    bool initiator = false;
+};
+
+// indexed by fd, translators are plain function pointers
+static std::vector<pair_state> fds;
+
+static cppevents::raw_event read_ping(int fd)
+{
+    uint64_t value = 0;
+    if (read(fd, &value, sizeof(value)) != sizeof(value))
+        return cppevents::empty_event{};
+
+    return ping{fd, value};
+}
+
+static void send_value(int fd, uint64_t value)
+{
+    if (write(fd, &value, sizeof(value)) != sizeof(value))
+        std::cerr << "ERROR: write failed\n";
+}
+
+static double run(std::size_t shard_count, std::size_t pairs_per_shard, double seconds)
+{
+    cppevents::event_queue_group group(shard_count);
+
+    group.on_event<ping>([](ping& ev) {
+        pair_state& state = fds[ev.fd];
+        if (state.initiator)
+            state.round_trips++;
+        send_value(state.peer, ev.value + 1);
+    });
+
+    std::vector<int> opened;
+    for (std::size_t i = 0; i < shard_count * pairs_per_shard; ++i)
+    {
+        int sv[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, sv) != 0)
+        {
+            std::cerr << "ERROR: socketpair failed\n";
+            return 0.0;
+        }
+
+        if (fds.size() <= std::size_t(std::max(sv[0], sv[1])))
+            fds.resize(std::max(sv[0], sv[1]) + 1);
+
+        fds[sv[0]] = pair_state{sv[1], 0, true};
+        fds[sv[1]] = pair_state{sv[0], 0, false};
+
+        std::size_t shard = i % shard_count;
+        group.add_native_source(sv[0], &read_ping, nullptr, cppevents::trigger_mode::level,
+                                cppevents::shard_policy::explicit_shard, shard);
+        group.add_native_source(sv[1], &read_ping, nullptr, cppevents::trigger_mode::level,
+                                cppevents::shard_policy::explicit_shard, shard);
+
+        opened.push_back(sv[0]);
+        opened.push_back(sv[1]);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (std::size_t i = 0; i < opened.size(); i += 2)
+        send_value(opened[i + 1], 0);
+
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    group.stop();
+
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+
+    uint64_t total = 0;
+    for (int fd : opened)
+    {
+        total += fds[fd].round_trips;
+        close(fd);
+    }
+
+    return total / elapsed.count();
+}
+
+int main(int argc, char* argv[])
+{
+    const std::size_t max_shards = argc > 1 ? std::atoi(argv[1]) : std::max(1u, std::thread::hardware_concurrency());
+    const std::size_t pairs_per_shard = argc > 2 ? std::atoi(argv[2]) : 64;
+    const double seconds = argc > 3 ? std::atof(argv[3]) : 2.0;
+
+    double single = 0.0;
+    for (std::size_t shards = 1; shards <= max_shards; shards *= 2)
+    {
+        double rate = run(shards, pairs_per_shard, seconds);
+        if (shards == 1)
+            single = rate;
+
+        std::cout << shards << " shards: " << rate / 1e6 << " M round trips/s"
+                  << " (" << rate / single << "x)\n";
+    }
+}
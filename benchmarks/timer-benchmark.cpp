@@ -0,0 +1,68 @@
+// Many periodic timers on one queue, like per-connection timeouts.
+// Reports the cost of starting, restarting and cancelling timers, and
+// how many wakeups it took to fire them.
+//
+// usage: timer-benchmark [timers] [seconds] [slack in ms]
+#include <cppevents/timer.hpp>
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+
+int main(int argc, char* argv[])
+{
+    using namespace std::chrono_literals;
+
+    const int timers = argc > 1 ? std::atoi(argv[1]) : 50'000;
+    const int seconds = argc > 2 ? std::atoi(argv[2]) : 2;
+    const auto slack = std::chrono::milliseconds(argc > 3 ? std::atoi(argv[3]) : 0);
+
+    cppevents::event_queue queue;
+
+    uint64_t expirations = 0;
+    uint64_t events = 0;
+    cppevents::on_event<cppevents::event::timer>([&](const cppevents::event::timer& ev) {
+        expirations += ev.expirations;
+        events++;
+    }, queue);
+
+    // intervals from 10ms to a second
+    auto interval = [](int i) { return std::chrono::milliseconds(10 + (i * 7919) % 991); };
+
+    auto per_timer = [timers](auto start) {
+        return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / timers;
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < timers; ++i)
+        queue.add_timer(cppevents::timer{i, interval(i), -1, slack});
+    const double add_ns = per_timer(start);
+
+    // restarting is what a connection timeout does on every read
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < timers; ++i)
+        queue.add_timer(cppevents::timer{i, interval(i + 1), -1, slack});
+    const double restart_ns = per_timer(start);
+
+    const cppevents::queue_statistics before = queue.statistics();
+
+    start = std::chrono::steady_clock::now();
+    while (std::chrono::steady_clock::now() - start < std::chrono::seconds(seconds))
+        queue.wait(100ms);
+
+    const cppevents::queue_statistics after = queue.statistics();
+    const uint64_t polls = after.poll_calls - before.poll_calls;
+
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < timers; ++i)
+        queue.cancel_timer(i);
+    const double cancel_ns = per_timer(start);
+
+    std::cout << timers << " timers, " << seconds << "s, " << slack.count() << "ms slack\n"
+              << "add:     " << add_ns << " ns/timer\n"
+              << "restart: " << restart_ns << " ns/timer\n"
+              << "cancel:  " << cancel_ns << " ns/timer\n"
+              << "fired:   " << events << " events, " << expirations << " expirations\n"
+              << "wakeups: " << polls << " (" << double(events) / polls << " events each), "
+              << after.timer_wakeups_saved - before.timer_wakeups_saved << " saved by slack\n";
+}
@@ -38,12 +38,10 @@ int main()
 
 
     //  Create a lambda function for handling keyboard events,
-    //  this might as well be a normal function
-    auto keyboard_handler = [&](cppevents::raw_event& raw) {
-        // Couldn't figure out a way to get rid of this cast,
-        // even though it's redundant, sorry.
-        auto event = event_cast<cppevents::event::keyboard>(raw);
-
+    //  this might as well be a normal function.  Handlers that take
+    //  the event type directly get a reference to the event without
+    //  any casts or copies.
+    auto keyboard_handler = [&](const cppevents::event::keyboard& event) {
         std::cout << "Key " << static_cast<uint32_t>(event.scancode) << " ";
         if (event.action == cppevents::event::keyboard::key_down)
             std::cout << "pressed\n";
@@ -62,15 +60,12 @@ int main()
     // to the keyboard_handler function
     cppevents::on_event<cppevents::event::keyboard>(keyboard_handler);
     // using the lambda directly with mouse motion events
-    cppevents::on_event<cppevents::event::mouse_motion>([&](cppevents::raw_event& raw){
-        auto event = event_cast<cppevents::event::mouse_motion>(raw);
+    cppevents::on_event<cppevents::event::mouse_motion>([&](const cppevents::event::mouse_motion& event){
         std::cout << "Mouse moved by " << event.x_relative << "," << event.y_relative << " to " << event.x_pixels << "," << event.y_pixels << "\n";
     });
 
     // ditto with buttons
-    cppevents::on_event<cppevents::event::mouse_button>([&](cppevents::raw_event& raw){
-        auto event = event_cast<cppevents::event::mouse_button>(raw);
-
+    cppevents::on_event<cppevents::event::mouse_button>([&](const cppevents::event::mouse_button& event){
         std::cout << "Mouse " << event.mouse_instance << " button " << static_cast<uint32_t>(event.button) << " ";
         if (event.action == cppevents::event::mouse_button::button_down)
             std::cout << "pressed ";
@@ -11,9 +11,7 @@ int main()
     cppevents::add_source(cppevents::timer{tick_timer, 2222ms, 500});
 
     auto last = std::chrono::system_clock::now();
-    cppevents::on_event<cppevents::event::timer>([&](cppevents::raw_event& raw) {
-        auto event = cppevents::event_cast<cppevents::event::timer>(raw);
-
+    cppevents::on_event<cppevents::event::timer>([&](const cppevents::event::timer& event) {
         auto now = std::chrono::system_clock::now();
 
         uint64_t ms = std::chrono::duration_cast<std::chrono::microseconds>(now - last).count();
@@ -0,0 +1,121 @@
+/*!
+ *  \file       buffer_pool.hpp
+ *  \brief      shared receive buffers from the event pool of the queue
+ *  \author     Jari Ronkainen
+ *  \version    0.1
+ */
+#ifndef LIBCPPEVENTS_BUFFER_POOL_HPP
+#define LIBCPPEVENTS_BUFFER_POOL_HPP
+
+#include "event_pool.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+
+namespace cppevents
+{
+    namespace detail
+    {
+        // sits in front of every buffer, in the block of the event pool
+        struct alignas(std::max_align_t) buffer_header
+        {
+            std::atomic<uint32_t> references;
+        };
+    }
+
+    /*!
+     *  \brief  Shared ownership of a receive buffer from the pool of a queue
+     *
+     *  Buffers are blocks of the event pool of the queue, of a size class
+     *  of their own.  Copies share the buffer, which goes back to the pool
+     *  once the last of them is released or destroyed.  That may happen
+     *  on any thread, also after the queue is gone.
+     */
+    class buffer_lease
+    {
+        public:
+            static constexpr std::size_t capacity = 16 * 1024;
+
+            buffer_lease() noexcept = default;
+
+            buffer_lease(const buffer_lease& other) noexcept : block{other.block}
+            {
+                if (block != nullptr)
+                    block->references.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            buffer_lease(buffer_lease&& other) noexcept : block{std::exchange(other.block, nullptr)} {}
+
+            buffer_lease& operator=(buffer_lease other) noexcept
+            {
+                std::swap(block, other.block);
+                return *this;
+            }
+
+            ~buffer_lease() { release(); }
+
+            /*!
+             *  \brief  Take a buffer
+             *
+             *  From the pool of the queue run by the calling thread,
+             *  or the global heap if there is none.
+             */
+            static buffer_lease acquire()
+            {
+                return buffer_lease(::new (detail::event_pool::allocate_buffer()) detail::buffer_header{1});
+            }
+
+            //! Give up this share of the buffer early
+            void release() noexcept
+            {
+                detail::buffer_header* released = std::exchange(block, nullptr);
+
+                // the writes of every holder happen before the buffer is reused
+                if (released != nullptr && released->references.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                {
+                    released->~buffer_header();
+                    detail::event_pool::deallocate(released);
+                }
+            }
+
+            std::byte* data() const noexcept
+            {
+                return block != nullptr ? reinterpret_cast<std::byte*>(block + 1) : nullptr;
+            }
+
+            explicit operator bool() const noexcept { return block != nullptr; }
+
+        private:
+            static_assert(sizeof(detail::buffer_header) + capacity <= detail::event_pool::buffer_bytes);
+
+            explicit buffer_lease(detail::buffer_header* block) noexcept : block{block} {}
+
+            detail::buffer_header* block = nullptr;
+    };
+}
+
+#endif
+/*
+    Copyright (c) 2021 Jari Ronkainen
+
+    This software is provided 'as-is', without any express or implied warranty.
+    In no event will the authors be held liable for any damages arising from the
+    use of this software.
+
+    Permission is granted to anyone to use this software for any purpose, including
+    commercial applications, and to alter it and redistribute it freely, subject to
+    the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not claim
+       that you wrote the original software. If you use this software in a product,
+       an acknowledgment in the product documentation would be appreciated but is
+       not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+       misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source distribution.
+*/
@@ -0,0 +1,199 @@
+/*!
+ *  \file       coroutine.hpp
+ *  \brief      awaiting events, readiness and time on an event queue
+ *  \author     Jari Ronkainen
+ *  \version    0.1
+ */
+#ifndef LIBCPPEVENTS_COROUTINE_HPP
+#define LIBCPPEVENTS_COROUTINE_HPP
+
+#include <chrono>
+#include <coroutine>
+#include <exception>
+#include <type_traits>
+
+#include "event_queue.hpp"
+
+namespace cppevents
+{
+    /*!
+     *  \brief  Coroutine run by an event queue
+     *
+     *  Starts right away and runs until its first suspension, after which
+     *  it is resumed from wait() or poll() of the queue it waits on.  The
+     *  frame frees itself when the coroutine finishes, nothing needs to
+     *  hold on to the task.
+     *
+     *  Frames started from a handler are allocated from the event pool of
+     *  the queue running it, so starting one costs no more than sending a
+     *  large event, and awaiting allocates nothing at all.  A frame may
+     *  outlive that queue.
+     *
+     *      cppevents::task session(int fd)
+     *      {
+     *          while (co_await cppevents::readable(fd) == error_code::success)
+     *              ...
+     *      }
+     */
+    class task
+    {
+        public:
+            struct promise_type
+            {
+                task get_return_object() noexcept { return {}; }
+
+                std::suspend_never initial_suspend() noexcept { return {}; }
+                std::suspend_never final_suspend() noexcept { return {}; }
+
+                void return_void() noexcept {}
+
+                // nobody is there to catch it
+                void unhandled_exception() noexcept { std::terminate(); }
+
+                static void* operator new(std::size_t size) { return detail::event_pool::allocate(size); }
+                static void operator delete(void* ptr) noexcept { detail::event_pool::deallocate(ptr); }
+            };
+    };
+
+    namespace detail
+    {
+        template <typename T>
+        class next_event_awaiter
+        {
+            static_assert(not is_group<T>::value, "awaiting a group is not supported, await one of its types");
+            static_assert(std::is_copy_constructible_v<T>, "every coroutine waiting for an event gets its own copy");
+
+            public:
+                explicit next_event_awaiter(event_queue& queue) noexcept : queue{queue} {}
+
+                bool await_ready() const noexcept { return false; }
+
+                void await_suspend(std::coroutine_handle<> handle)
+                {
+                    waiter.handle = handle;
+                    queue.await_event(get_event_type_id_for<T>(), waiter);
+                }
+
+                T await_resume() { return unchecked_event_cast<T>(*waiter.event); }
+
+            private:
+                event_queue& queue;
+                event_waiter waiter;
+        };
+
+        class readable_awaiter
+        {
+            public:
+                readable_awaiter(native_source_type fd, event_queue& queue) noexcept : queue{queue}, fd{fd} {}
+
+                bool await_ready() const noexcept { return false; }
+
+                bool await_suspend(std::coroutine_handle<> handle)
+                {
+                    waiter.handle = handle;
+                    return queue.await_readable(fd, waiter, result);
+                }
+
+                error_code await_resume() const noexcept { return result; }
+
+            private:
+                event_queue& queue;
+                native_source_type fd;
+                readiness_waiter waiter;
+                error_code result = error_code::success;
+        };
+
+        class deadline_awaiter
+        {
+            public:
+                deadline_awaiter(std::chrono::steady_clock::time_point deadline, event_queue& queue) noexcept : queue{queue}
+                {
+                    waiter.deadline = deadline;
+                }
+
+                bool await_ready() const noexcept { return waiter.deadline <= std::chrono::steady_clock::now(); }
+
+                void await_suspend(std::coroutine_handle<> handle)
+                {
+                    waiter.handle = handle;
+                    queue.await_deadline(waiter);
+                }
+
+                void await_resume() const noexcept {}
+
+            private:
+                event_queue& queue;
+                deadline_waiter waiter;
+        };
+    }
+
+    /*!
+     *  \brief  Wait for the next event of type T
+     *
+     *  \return copy of the event, handlers bound to the type still get it
+     */
+    template <typename T>
+    detail::next_event_awaiter<T> event_queue::next() noexcept
+    {
+        return detail::next_event_awaiter<T>(*this);
+    }
+
+    /*!
+     *  \brief  Wait until a descriptor is readable
+     *
+     *  Readiness is edge triggered: after resuming, read until the
+     *  descriptor would block, or the next await may never return.  The
+     *  descriptor stays watched until given to remove_native_source,
+     *  which must be done before closing it.
+     *
+     *  \return error_code::already_exists if it is a native source of the
+     *          queue or another coroutine is waiting on it
+     */
+    inline detail::readable_awaiter readable(native_source_type fd, event_queue& queue = default_queue) noexcept
+    {
+        return detail::readable_awaiter(fd, queue);
+    }
+
+    //! Wait until a point in time
+    template <typename Clock, typename Duration>
+    detail::deadline_awaiter sleep_until(std::chrono::time_point<Clock, Duration> time, event_queue& queue = default_queue)
+    {
+        if constexpr (std::is_same_v<Clock, std::chrono::steady_clock>) {
+            return detail::deadline_awaiter(std::chrono::ceil<std::chrono::steady_clock::duration>(time), queue);
+        } else {
+            return detail::deadline_awaiter(std::chrono::steady_clock::now()
+                                            + std::chrono::ceil<std::chrono::steady_clock::duration>(time - Clock::now()), queue);
+        }
+    }
+
+    //! Wait for a while
+    template <typename Rep, typename Period>
+    detail::deadline_awaiter sleep_for(std::chrono::duration<Rep, Period> duration, event_queue& queue = default_queue)
+    {
+        return detail::deadline_awaiter(std::chrono::steady_clock::now()
+                                        + std::chrono::ceil<std::chrono::steady_clock::duration>(duration), queue);
+    }
+}
+
+#endif
+/*
+    Copyright (c) 2021 Jari Ronkainen
+
+    This software is provided 'as-is', without any express or implied warranty.
+    In no event will the authors be held liable for any damages arising from the
+    use of this software.
+
+    Permission is granted to anyone to use this software for any purpose, including
+    commercial applications, and to alter it and redistribute it freely, subject to
+    the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not claim
+       that you wrote the original software. If you use this software in a product,
+       an acknowledgment in the product documentation would be appreciated but is
+       not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+       misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source distribution.
+*/
@@ -7,62 +7,144 @@
 #ifndef CPPEVENTS_EVENT_HPP
 #define CPPEVENTS_EVENT_HPP
 
+#include <cstddef>
 #include <cstdlib>
 #include <cassert>
 #include <cstring>
-#include <atomic>
 #include <memory>
+#include <new>
+#include <optional>
+#include <string_view>
+#include <type_traits>
+#include <utility>
 
 #include "common.hpp"
+#include "event_pool.hpp"
 
 #include <iostream>
 
+#ifndef CPPEVENTS_EVENT_INLINE_SIZE
+#define CPPEVENTS_EVENT_INLINE_SIZE (3 * sizeof(void*))
+#endif
+
+#ifndef CPPEVENTS_EVENT_INLINE_ALIGN
+#define CPPEVENTS_EVENT_INLINE_ALIGN alignof(void*)
+#endif
+
 namespace cppevents
 {
-    class raw_event;
+    template <std::size_t InlineBytes, std::size_t Align> class basic_raw_event;
+
+    /*!
+     *  \brief  Event type used by the event queues
+     *
+     *  The size of the inline buffer is a build option, every translation
+     *  unit using libcppevents must see the same CPPEVENTS_EVENT_INLINE_SIZE
+     *  and CPPEVENTS_EVENT_INLINE_ALIGN as the library itself.
+     */
+    using raw_event = basic_raw_event<CPPEVENTS_EVENT_INLINE_SIZE, CPPEVENTS_EVENT_INLINE_ALIGN>;
 
     namespace detail
     {
-        using data_buffer_type = std::aligned_storage<3 * sizeof(void*), std::alignment_of<void*>::value>::type;
-
-        inline std::atomic<event_details::id_type> event_id_counter = 0;
-
-        // group 0 is "no group"
-        inline std::atomic<event_details::id_type> group_id_counter = 1;
+        /*!
+         *  \brief  Name of a type as spelled by the compiler
+         *
+         *  Only the part naming T is kept, so the name does not depend on
+         *  how this function itself gets printed.
+         */
+        template <typename T>
+        constexpr std::string_view type_name() noexcept
+        {
+            #if defined(_MSC_VER)
+            std::string_view name = __FUNCSIG__;
+            const std::size_t begin = name.find("type_name<") + 10;
+            const std::size_t end = name.rfind(">(void)");
+            #else
+            std::string_view name = __PRETTY_FUNCTION__;
+            const std::size_t begin = name.find("T = ") + 4;
+            const std::size_t end = name.find_first_of(";]", begin);
+            #endif
+            return name.substr(begin, end - begin);
+        }
 
-        template <typename T> struct internal_event_handler;
-        template <typename T> struct external_event_handler;
+        // 64-bit FNV-1a, 0 is reserved for "no id"
+        constexpr event_details::id_type hash_type_name(std::string_view name) noexcept
+        {
+            event_details::id_type hash = 0xcbf29ce484222325ull;
+            for (char c : name)
+            {
+                hash ^= static_cast<unsigned char>(c);
+                hash *= 0x100000001b3ull;
+            }
+            return hash != 0 ? hash : 1;
+        }
 
-        enum class handler_action
+        template <typename T>
+        constexpr event_details::id_type id_for() noexcept
         {
-            destroy,
-            move,
-            get
-        };
+            if constexpr (requires { T::event_id; })
+            {
+                static_assert(T::event_id != 0, "event id 0 is reserved");
+                return T::event_id;
+            }
+            else
+            {
+                return hash_type_name(type_name<T>());
+            }
+        }
 
-        union event_storage
+        template <typename T, typename Event> struct internal_event_handler;
+        template <typename T, typename Event> struct external_event_handler;
+
+        /*!
+         *  \brief  Per-type operations of an event
+         *
+         *  A null relocate means the storage can be moved with memcpy, a null
+         *  destroy that there is nothing to destroy.  Events where both would
+         *  be null have no table at all.
+         */
+        template <typename Event>
+        struct event_operations
         {
-            void* ptr = nullptr;
-            data_buffer_type data;
+            void (*relocate)(Event& from, Event& to) noexcept;
+            void (*destroy)(Event& self) noexcept;
         };
 
-        using handler_ptr = void* (*)(handler_action, raw_event const*, raw_event*);
+        template <typename T, std::size_t InlineBytes, std::size_t Align>
+        T& unchecked_event_cast(basic_raw_event<InlineBytes, Align>&) noexcept;
     }
 
     /*!
+     *  \brief  Types that can be moved to another address with memcpy
      *
+     *  Trivially copyable types are detected automatically, specialise
+     *  this for other types where moving the bytes and forgetting the
+     *  source is enough, e.g. types holding a std::unique_ptr.
      */
     template <typename T>
-    event_details::id_type get_event_group_id_for() {
-        static event_details::id_type ids = detail::group_id_counter++;
-        return ids;
+    struct is_trivially_relocatable : std::is_trivially_copyable<T> {};
+
+    /*!
+     *  \brief  Get the id of an event type or event group
+     *
+     *  Ids are computed at compile time from the name of the type, so they
+     *  are the same in every shared library and every run of the program
+     *  and can be used as case labels.  A type can pick its own id with a
+     *  static constexpr event_id member, the queue reports a collision when
+     *  two types with the same id are bound.
+     */
+    template <typename T>
+    constexpr event_details::id_type get_event_group_id_for() noexcept {
+        return detail::id_for<T>();
     }
     template <typename T>
-    event_details::id_type get_event_type_id_for() {
-        static event_details::id_type ids = detail::event_id_counter++;
-        return ids;
+    constexpr event_details::id_type get_event_type_id_for() noexcept {
+        return detail::id_for<T>();
     }
 
+    template <typename T>
+    inline constexpr event_details::id_type event_type_id = get_event_type_id_for<T>();
+
     /*!
      *  \brief  Get an event_details for a template type
      *
@@ -70,7 +152,7 @@ namespace cppevents
      */
 
     template <typename T>
-    event_details get_event_details_for()
+    constexpr event_details get_event_details_for() noexcept
     {
         static_assert(!std::is_same_v<raw_event, T>);
         static_assert(std::is_same_v<std::decay_t<T>, T>);
@@ -87,7 +169,7 @@ namespace cppevents
     template <typename T> requires requires (T t) {
         typename T::group;
     }
-    event_details get_event_details_for()
+    constexpr event_details get_event_details_for() noexcept
     {
         static_assert(!std::is_same_v<raw_event, T>);
         static_assert(std::is_same_v<std::decay_t<T>, T>);
@@ -106,25 +188,37 @@ namespace cppevents
      *
      *  Used with event_cast to take care of differing event types.  Much of
      *  this was inspired by libc++ std::any implementation.
+     *
+     *  Event data up to InlineBytes in size and Align in alignment is
+     *  stored in the event itself, anything larger is allocated from the
+     *  event pool.
      */
-    class raw_event
+    template <std::size_t InlineBytes, std::size_t Align>
+    class basic_raw_event
     {
+        static_assert(InlineBytes >= sizeof(void*), "inline buffer must be able to hold a pointer");
+        static_assert(Align >= alignof(void*) && (Align & (Align - 1)) == 0, "invalid inline buffer alignment");
+
         public:
+            static constexpr std::size_t inline_size = InlineBytes;
+            static constexpr std::size_t inline_alignment = Align;
+
+            //! True if data of type T is stored inside the event
+            template <typename T>
+            static constexpr bool stored_inline = (sizeof(T) <= InlineBytes) && (alignof(T) <= Align);
+
             template <typename ValueType, typename T = std::decay_t<ValueType>>
-            raw_event(ValueType&&);
+            basic_raw_event(ValueType&&);
 
-            raw_event(const raw_event&) = delete;
-            raw_event(raw_event&& other) noexcept
+            basic_raw_event(const basic_raw_event&) = delete;
+            basic_raw_event(basic_raw_event&& other) noexcept
             {
-                if (other.handler != nullptr)
-                    other.handler(detail::handler_action::move, &other, this);
-                details = other.details;
+                take(other);
             }
 
-            ~raw_event()
+            ~basic_raw_event()
             {
-                if (handler != nullptr)
-                    handler(detail::handler_action::destroy, this, nullptr);
+                reset();
             }
 
             //! Get event type id for this event
@@ -133,154 +227,237 @@ namespace cppevents
             //! Get event group id
             event_details::id_type group() const noexcept { return details.group_id; }
 
-            raw_event& operator=(raw_event&& other) noexcept
+            basic_raw_event& operator=(basic_raw_event&& other) noexcept
             {
-                if (other.handler != nullptr)
-                    other.handler(detail::handler_action::move, &other, this);
-                details = other.details;
+                if (this != &other)
+                {
+                    reset();
+                    take(other);
+                }
                 return *this;
             }
 
         private:
-            template <typename T> using use_small_object_optimisation =
-                std::bool_constant<(sizeof(T) <= sizeof(detail::event_storage)) && (alignof(T) <= alignof(detail::event_storage))>;
+            using operations_type = detail::event_operations<basic_raw_event>;
 
-            template <typename T> friend struct detail::internal_event_handler;
-            template <typename T> friend struct detail::external_event_handler;
+            union event_storage
+            {
+                void* ptr = nullptr;
+                alignas(Align) std::byte data[InlineBytes];
+            };
+
+            // the storage is always copied as bytes, which is all it takes
+            // for trivially relocatable data and for data in the event pool.
+            // a moved-from event is left without a type
+            void take(basic_raw_event& other) noexcept
+            {
+                storage = other.storage;
+                details = std::exchange(other.details, event_details{});
+                operations = std::exchange(other.operations, nullptr);
 
-            template <typename T> friend T event_cast(raw_event& ev);
+                if (operations != nullptr && operations->relocate != nullptr)
+                    operations->relocate(other, *this);
+            }
+
+            void reset() noexcept
+            {
+                if (operations != nullptr && operations->destroy != nullptr)
+                    operations->destroy(*this);
+                operations = nullptr;
+            }
+
+            template <typename T, typename Event> friend struct detail::internal_event_handler;
+            template <typename T, typename Event> friend struct detail::external_event_handler;
+
+            template <typename T, std::size_t N, std::size_t A>
+            friend T& detail::unchecked_event_cast(basic_raw_event<N, A>&) noexcept;
 
             template <typename T>
-            using preferred_handler = typename std::conditional<use_small_object_optimisation<T>::value,
-                                                                detail::internal_event_handler<T>,
-                                                                detail::external_event_handler<T>>::type;
+            using preferred_handler = typename std::conditional<stored_inline<T>,
+                                                                detail::internal_event_handler<T, basic_raw_event>,
+                                                                detail::external_event_handler<T, basic_raw_event>>::type;
 
             event_details details = {
                 .group_id = 0,
                 .event_id = 0
             };
 
-            detail::handler_ptr handler = nullptr;
-            detail::event_storage storage;
+            const operations_type* operations = nullptr;
+            event_storage storage;
     };
 
+    template <std::size_t InlineBytes, std::size_t Align>
     template <typename ValueType, typename T>
-    raw_event::raw_event(ValueType&& value)
+    basic_raw_event<InlineBytes, Align>::basic_raw_event(ValueType&& value)
     {
         preferred_handler<T>::create(*this, std::forward<T>(value));
     }
 
+    /*!
+     *  \brief  Check at compile time that event types are stored inline
+     *
+     *  Fails to compile naming the first type that would be allocated
+     *  from the event pool, e.g.
+     *
+     *      static_assert(require_inline_storage<raw_event, event::keyboard, event::signal>);
+     */
+    template <typename Event, typename T>
+    struct inline_storage_check
+    {
+        static_assert(Event::template stored_inline<T>, "event type does not fit the inline buffer of raw_event, see the instantiation of inline_storage_check for the type");
+        static constexpr bool value = Event::template stored_inline<T>;
+    };
+
+    template <typename Event, typename... Types>
+    inline constexpr bool require_inline_storage = (inline_storage_check<Event, Types>::value && ...);
+
     // Type to handle events with small-object-optimisation
-    template <typename T>
+    template <typename T, typename Event>
     struct detail::internal_event_handler
     {
-        template <typename... Arguments>
-        static T& create(raw_event& dest, Arguments&&... args)
-        {
-            T* rval = new (&dest.storage.data) T(std::forward<Arguments>(args)...);
-            dest.handler = &internal_event_handler::handle;
-            dest.details = get_event_details_for<T>();
-            return *rval;
-        }
+        static constexpr bool trivial_relocation = is_trivially_relocatable<T>::value;
+        static constexpr bool trivial_destruction = std::is_trivially_destructible_v<T>;
 
-        template <typename... Arguments>
-        static T& create_noid(raw_event& dest, Arguments&&... args)
+        static T& data(Event& self) noexcept
         {
-            T* rval = new (&dest.storage.data) T(std::forward<Arguments>(args)...);
-            dest.handler = &internal_event_handler::handle;
-            return *rval;
+            return *std::launder(static_cast<T*>(static_cast<void*>(&self.storage.data)));
         }
 
-
-        static void destroy(raw_event& self)
+        static void relocate(Event& self, Event& dest) noexcept
         {
-            T& val = *static_cast<T*>(static_cast<void*>(&self.storage.data));
-            val.~T();
-            self.handler = nullptr;
+            ::new (static_cast<void*>(&dest.storage.data)) T(std::move(data(self)));
+            data(self).~T();
         }
 
-        static void move(raw_event& self, raw_event& dest)
+        static void destroy(Event& self) noexcept
         {
-            create_noid(dest, std::move(*static_cast<T*>(static_cast<void*>(&self.storage.data))));
-            dest.details = self.details;
-            destroy(self);
+            data(self).~T();
         }
 
-        static void* get(raw_event& self)
-        {
-            if (self.details == get_event_details_for<T>())
-                return static_cast<void*>(&self.storage.data);
-            return nullptr;
-        }
+        static constexpr typename Event::operations_type operations = {
+            .relocate   = trivial_relocation ? nullptr : &relocate,
+            .destroy    = trivial_destruction ? nullptr : &destroy,
+        };
 
-        static void* handle(handler_action act, raw_event const* self, raw_event* other)
+        template <typename... Arguments>
+        static T& create(Event& dest, Arguments&&... args)
         {
-            switch(act)
-            {
-                case handler_action::destroy:
-                    destroy(const_cast<raw_event&>(*self));
-                    return nullptr;
-                case handler_action::move:
-                    move(const_cast<raw_event&>(*self), *other);
-                    return nullptr;
-                case handler_action::get:
-                    return get(const_cast<raw_event&>(*self));
-            }
-            return nullptr;
+            T* rval = ::new (static_cast<void*>(&dest.storage.data)) T(std::forward<Arguments>(args)...);
+
+            if constexpr (trivial_relocation && trivial_destruction)
+                dest.operations = nullptr;
+            else
+                dest.operations = &operations;
+
+            dest.details = get_event_details_for<T>();
+            return *rval;
         }
     };
 
-    // Type to handle events without small-object-optimisation
-    template <typename T>
+    // Type to handle events without small-object-optimisation, the data
+    // comes from the event pool of the thread unless it is over-aligned.
+    // Moving these only moves the pointer.
+    template <typename T, typename Event>
     struct detail::external_event_handler
     {
-        static void* handle(handler_action act, raw_event const* self, raw_event* other)
+        static constexpr bool use_pool = alignof(T) <= event_pool::header_size;
+
+        static void destroy(Event& self) noexcept
         {
-            switch(act)
+            if constexpr (use_pool)
             {
-                case handler_action::destroy:
-                    destroy(const_cast<raw_event&>(*self));
-                    return nullptr;
-                case handler_action::move:
-                    move(const_cast<raw_event&>(*self), *other);
-                    return nullptr;
-                case handler_action::get:
-                    return get(const_cast<raw_event&>(*self));
+                static_cast<T*>(self.storage.ptr)->~T();
+                event_pool::deallocate(self.storage.ptr);
+            }
+            else
+            {
+                delete static_cast<T*>(self.storage.ptr);
             }
-            // unreachable, this shuts up gcc
-            return nullptr;
         }
 
+        static constexpr typename Event::operations_type operations = {
+            .relocate   = nullptr,
+            .destroy    = &destroy,
+        };
+
         template <typename... Arguments>
-        static T& create(raw_event& dest, Arguments&&... args)
+        static T& create(Event& dest, Arguments&&... args)
         {
-            dest.storage.ptr = ::new T(std::forward<Arguments>(args)...);
-            dest.handler = &external_event_handler::handle;
+            if constexpr (use_pool)
+                dest.storage.ptr = ::new (event_pool::allocate(sizeof(T))) T(std::forward<Arguments>(args)...);
+            else
+                dest.storage.ptr = ::new T(std::forward<Arguments>(args)...);
+            dest.operations = &operations;
             dest.details = get_event_details_for<T>();
             return *static_cast<T*>(dest.storage.ptr);
         }
+    };
 
-        static void destroy(raw_event& self)
-        {
-            delete static_cast<T*>(self.storage.ptr);
-            self.handler = nullptr;
-        }
+    /*!
+     *  \brief  Access the payload of an event without checking its type
+     *
+     *  Only for callers that already know the event type, e.g. handlers
+     *  that the queue only calls for a single event id.  Where the payload
+     *  lives is decided at compile time, so this is just pointer math.
+     */
+    template <typename T, std::size_t InlineBytes, std::size_t Align>
+    T& detail::unchecked_event_cast(basic_raw_event<InlineBytes, Align>& ev) noexcept
+    {
+        if constexpr (basic_raw_event<InlineBytes, Align>::template stored_inline<T>)
+            return detail::internal_event_handler<T, basic_raw_event<InlineBytes, Align>>::data(ev);
+        else
+            return *static_cast<T*>(ev.storage.ptr);
+    }
 
-        static void move(raw_event& self, raw_event& dest)
-        {
-            dest.storage.ptr = self.storage.ptr;
-            dest.handler = &external_event_handler::handle;
-            dest.details = self.details;
-            self.handler = nullptr;
-        }
+    /*!
+     *  \brief  Get a pointer to the event data if the event is of type T
+     *
+     *  \param  ev  reference to a generic event
+     *
+     *  \return Pointer into the event storage, nullptr if the event
+     *          is not of the type requested
+     */
+    template <typename T, std::size_t InlineBytes, std::size_t Align>
+    T* event_ptr(basic_raw_event<InlineBytes, Align>& ev) noexcept
+    {
+        using raw_type = typename std::remove_cvref<T>::type;
 
-        static void* get(raw_event& self)
-        {
-            if (self.details == get_event_details_for<T>())
-                return self.storage.ptr;
+        if (ev.type() != get_event_type_id_for<raw_type>())
             return nullptr;
-        }
-    };
+
+        return &detail::unchecked_event_cast<raw_type>(ev);
+    }
+
+    template <typename T, std::size_t InlineBytes, std::size_t Align>
+    const T* event_ptr(const basic_raw_event<InlineBytes, Align>& ev) noexcept
+    {
+        return event_ptr<T>(const_cast<basic_raw_event<InlineBytes, Align>&>(ev));
+    }
+
+    /*!
+     *  \brief  Get a reference to the event data
+     *
+     *  \param  ev  reference to a generic event
+     *
+     *  The type of the event given must match event id of the type,
+     *  use event_ptr if that is not known.
+     *
+     *  \return Reference into the event storage
+     */
+    template <typename T, std::size_t InlineBytes, std::size_t Align>
+    T& event_ref(basic_raw_event<InlineBytes, Align>& ev) noexcept
+    {
+        using raw_type = typename std::remove_cvref<T>::type;
+
+        assert(get_event_type_id_for<raw_type>() == ev.type());
+        return detail::unchecked_event_cast<raw_type>(ev);
+    }
+
+    template <typename T, std::size_t InlineBytes, std::size_t Align>
+    const T& event_ref(const basic_raw_event<InlineBytes, Align>& ev) noexcept
+    {
+        return event_ref<T>(const_cast<basic_raw_event<InlineBytes, Align>&>(ev));
+    }
 
     /*!
      *  \brief  Cast an event to a more specific type
@@ -288,20 +465,48 @@ namespace cppevents
      *  \param  ev  reference to a generic event
      *
      *  Converts a libcppevent generic event type to a type requested,
-     *  the type of the event given must match event id of the type
+     *  the type of the event given must match event id of the type.
+     *  This copies the event data, prefer event_ref or event_ptr for
+     *  anything large.
      *
      *  \return Type requested
      */
-    template <typename T>
-    T event_cast(raw_event& ev)
+    template <typename T, std::size_t InlineBytes, std::size_t Align>
+    T event_cast(basic_raw_event<InlineBytes, Align>& ev)
     {
-        using raw_type = typename std::remove_cvref<T>::type;
+        return event_ref<T>(ev);
+    }
 
-        raw_type* ptr = reinterpret_cast<raw_type*>(raw_event::preferred_handler<raw_type>::handle(detail::handler_action::get, &ev, nullptr));
-        assert(get_event_details_for<T>().event_id == ev.type());
-        assert(ptr != nullptr);
+    /*!
+     *  \brief  Move the event data out of an event
+     *
+     *  \param  ev  generic event that is consumed
+     *
+     *  The type of the event given must match event id of the type,
+     *  the event is left holding a moved-from value.
+     *
+     *  \return Type requested
+     */
+    template <typename T, std::size_t InlineBytes, std::size_t Align>
+    T event_cast(basic_raw_event<InlineBytes, Align>&& ev)
+    {
+        return std::move(event_ref<T>(ev));
+    }
 
-        return *ptr;
+    /*!
+     *  \brief  Move the event data out of an event if it is of type T
+     *
+     *  \param  ev  generic event that is consumed
+     *
+     *  \return The event data, or an empty optional if the event is not
+     *          of the type requested
+     */
+    template <typename T, std::size_t InlineBytes, std::size_t Align>
+    std::optional<T> try_event_cast(basic_raw_event<InlineBytes, Align>&& ev)
+    {
+        if (auto* ptr = event_ptr<T>(ev))
+            return std::move(*ptr);
+        return std::nullopt;
     }
 }
 
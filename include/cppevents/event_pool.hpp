@@ -0,0 +1,377 @@
+/*!
+ *  \file       event_pool.hpp
+ *  \brief      size-class pool for events too large to store inline
+ *  \author     Jari Ronkainen
+ *  \version    0.1
+ */
+#ifndef LIBCPPEVENTS_EVENT_POOL_HPP
+#define LIBCPPEVENTS_EVENT_POOL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <new>
+#include <thread>
+
+namespace cppevents::detail
+{
+    /*!
+     *  \brief  Slab allocator for event data
+     *
+     *  Every event queue owns one of these, and it is the current pool of
+     *  a thread while the thread is in wait() or poll() of the queue.
+     *  Events that do not fit the inline
+     *  buffer of raw_event are allocated from fixed size classes carved out
+     *  of slabs, and freed blocks go to per-class free lists that only the
+     *  owning thread touches.  Blocks freed by other threads are pushed on
+     *  a lock-free stack and picked up when the owner runs out.
+     *
+     *  Receive buffers of the queue come from the same pool, as blocks of
+     *  a class of their own larger than any event class.
+     *
+     *  Slabs come from an upstream std::pmr::memory_resource and are only
+     *  given back when the pool is gone, so in steady state no memory is
+     *  requested from the system at all.  Blocks may outlive the queue:
+     *  the queue abandons its pool, and the pool goes away when the last
+     *  block still out is freed.
+     */
+    class event_pool
+    {
+        public:
+            struct statistics
+            {
+                uint64_t allocations            = 0;
+                uint64_t slab_allocations       = 0;
+                uint64_t oversize_allocations   = 0;
+                uint64_t remote_deallocations   = 0;
+
+                uint64_t buffer_allocations             = 0;
+                uint64_t buffer_slab_allocations        = 0;
+                uint64_t buffer_remote_deallocations    = 0;
+            };
+
+            // every block starts with a header telling where it came from,
+            // sized so that the data after it stays max-aligned
+            static constexpr std::size_t header_size = alignof(std::max_align_t);
+
+            static constexpr std::size_t smallest_block = 32;
+            static constexpr std::size_t class_count = 6;
+            static constexpr std::size_t largest_block = smallest_block << (class_count - 1);
+
+            static constexpr std::size_t slab_size = 64 * 1024;
+
+            // a receive buffer and the reference count in front of it,
+            // handed out by allocate_buffer sixteen to a slab
+            static constexpr std::size_t buffer_class = class_count;
+            static constexpr std::size_t buffer_bytes = 16 * 1024 + header_size;
+            static constexpr std::size_t buffers_per_slab = 16;
+
+            //! New pool owned by the calling thread, given up with abandon()
+            static event_pool& create(std::pmr::memory_resource* upstream = std::pmr::new_delete_resource())
+            {
+                return *new event_pool(upstream);
+            }
+
+            event_pool(const event_pool&) = delete;
+            event_pool& operator=(const event_pool&) = delete;
+
+            /*!
+             *  \brief  Give up the pool
+             *
+             *  Blocks still out may be freed later on any thread, the pool
+             *  and its slabs are freed with the last of them.  Called from
+             *  the owner, or from a thread the owner is done with.
+             */
+            void abandon() noexcept
+            {
+                // whatever is freed from now on goes through the remote
+                // stack and the count of blocks out
+                owner.store(std::thread::id{}, std::memory_order_relaxed);
+
+                const int64_t blocks = static_cast<int64_t>(owned_blocks);
+                if (blocks_out.fetch_add(blocks - abandon_bias, std::memory_order_acq_rel) == abandon_bias - blocks)
+                    delete this;
+            }
+
+            //! Memory resource new slabs are taken from
+            void set_upstream(std::pmr::memory_resource* resource) noexcept { upstream = resource; }
+
+            //! Thread that is allowed to use the free lists directly
+            void set_owner(std::thread::id id) noexcept { owner.store(id, std::memory_order_relaxed); }
+
+            statistics stats() const noexcept
+            {
+                statistics rval = counters;
+                rval.remote_deallocations = remote_deallocations.load(std::memory_order_relaxed);
+                rval.buffer_remote_deallocations = remote_buffer_deallocations.load(std::memory_order_relaxed);
+                return rval;
+            }
+
+            /*!
+             *  \brief  Allocate storage for data of given size
+             *
+             *  Uses the pool of the calling thread when there is one,
+             *  the global heap otherwise.
+             */
+            static void* allocate(std::size_t bytes);
+
+            //! Allocate a block of buffer_bytes the same way
+            static void* allocate_buffer();
+
+            //! Free storage returned by allocate, from any thread
+            static void deallocate(void* ptr) noexcept;
+
+        private:
+            explicit event_pool(std::pmr::memory_resource* upstream) noexcept : upstream{upstream} {}
+
+            ~event_pool()
+            {
+                while (slabs != nullptr)
+                {
+                    slab_record* next = slabs->next;
+                    slabs->resource->deallocate(slabs, slabs->bytes, alignof(std::max_align_t));
+                    slabs = next;
+                }
+            }
+
+            struct block_header
+            {
+                event_pool* pool;
+                std::size_t size_class;
+            };
+            static_assert(sizeof(block_header) <= header_size);
+
+            struct free_block
+            {
+                free_block* next;
+            };
+
+            struct slab_record
+            {
+                slab_record* next;
+                std::pmr::memory_resource* resource;
+                std::size_t bytes;
+            };
+
+            static constexpr std::size_t block_size(std::size_t size_class) noexcept
+            {
+                return size_class == buffer_class ? header_size + buffer_bytes : smallest_block << size_class;
+            }
+
+            static constexpr std::size_t slab_bytes(std::size_t size_class) noexcept
+            {
+                return size_class == buffer_class ? record_size + buffers_per_slab * block_size(size_class) : slab_size;
+            }
+
+            // slab record rounded up so that the blocks after it stay aligned
+            static constexpr std::size_t record_size = (sizeof(slab_record) + header_size - 1) / header_size * header_size;
+
+            static constexpr std::size_t size_class_for(std::size_t bytes) noexcept
+            {
+                std::size_t size_class = 0;
+                while (size_class < class_count && block_size(size_class) < bytes + header_size)
+                    size_class++;
+                return size_class;
+            }
+
+            static block_header* header_of(void* ptr) noexcept
+            {
+                return reinterpret_cast<block_header*>(static_cast<std::byte*>(ptr) - header_size);
+            }
+
+            static void* data_of(block_header* header) noexcept
+            {
+                return reinterpret_cast<std::byte*>(header) + header_size;
+            }
+
+            void* allocate_block(std::size_t size_class)
+            {
+                if (free_lists[size_class] == nullptr)
+                    reclaim_remote_blocks();
+                if (free_lists[size_class] == nullptr)
+                    refill(size_class);
+
+                free_block* block = free_lists[size_class];
+                free_lists[size_class] = block->next;
+
+                if (size_class == buffer_class)
+                    counters.buffer_allocations++;
+                else
+                    counters.allocations++;
+
+                owned_blocks++;
+
+                return block;
+            }
+
+            void release_block(block_header* header) noexcept
+            {
+                free_block* block = reinterpret_cast<free_block*>(data_of(header));
+
+                if (std::this_thread::get_id() == owner.load(std::memory_order_relaxed))
+                {
+                    block->next = free_lists[header->size_class];
+                    free_lists[header->size_class] = block;
+                    owned_blocks--;
+                    return;
+                }
+
+                block->next = remote_blocks.load(std::memory_order_relaxed);
+                while (not remote_blocks.compare_exchange_weak(block->next, block,
+                                                               std::memory_order_release,
+                                                               std::memory_order_relaxed));
+
+                if (header->size_class == buffer_class)
+                    remote_buffer_deallocations.fetch_add(1, std::memory_order_relaxed);
+                else
+                    remote_deallocations.fetch_add(1, std::memory_order_relaxed);
+
+                // the last block of an abandoned pool
+                if (blocks_out.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                    delete this;
+            }
+
+            void reclaim_remote_blocks() noexcept
+            {
+                free_block* block = remote_blocks.exchange(nullptr, std::memory_order_acquire);
+                while (block != nullptr)
+                {
+                    free_block* next = block->next;
+                    std::size_t size_class = header_of(block)->size_class;
+                    block->next = free_lists[size_class];
+                    free_lists[size_class] = block;
+                    block = next;
+                }
+            }
+
+            void refill(std::size_t size_class)
+            {
+                const std::size_t bytes = slab_bytes(size_class);
+                const std::size_t stride = block_size(size_class);
+
+                void* memory = upstream->allocate(bytes, alignof(std::max_align_t));
+                slabs = ::new (memory) slab_record{slabs, upstream, bytes};
+
+                if (size_class == buffer_class)
+                    counters.buffer_slab_allocations++;
+                else
+                    counters.slab_allocations++;
+
+                std::byte* begin = static_cast<std::byte*>(memory) + record_size;
+                std::byte* end = static_cast<std::byte*>(memory) + bytes;
+
+                for (std::byte* pos = begin; pos + stride <= end; pos += stride)
+                {
+                    block_header* header = ::new (pos) block_header{this, size_class};
+                    free_block* block = ::new (data_of(header)) free_block{free_lists[size_class]};
+                    free_lists[size_class] = block;
+                }
+            }
+
+            std::pmr::memory_resource* upstream;
+            slab_record* slabs = nullptr;
+
+            free_block* free_lists[class_count + 1] = {};
+            std::atomic<free_block*> remote_blocks = nullptr;
+
+            std::atomic<std::thread::id> owner = std::this_thread::get_id();
+
+            // blocks taken minus those the owner freed itself, and blocks
+            // freed by other threads counted down from a bias that keeps
+            // the count off zero until the pool is abandoned.  abandoning
+            // trades the bias for the owner count, so that blocks_out is
+            // the number of blocks still out from then on
+            static constexpr int64_t abandon_bias = int64_t(1) << 62;
+
+            uint64_t owned_blocks = 0;
+            std::atomic<int64_t> blocks_out = abandon_bias;
+
+            statistics counters;
+            std::atomic<uint64_t> remote_deallocations = 0;
+            std::atomic<uint64_t> remote_buffer_deallocations = 0;
+    };
+
+    //! Pool used for event data allocated on this thread, may be null
+    inline event_pool*& current_event_pool() noexcept
+    {
+        thread_local event_pool* pool = nullptr;
+        return pool;
+    }
+
+    inline void* event_pool::allocate(std::size_t bytes)
+    {
+        event_pool* pool = current_event_pool();
+        const std::size_t size_class = size_class_for(bytes);
+
+        // the queue may have moved on to another thread since
+        if (pool != nullptr && pool->owner.load(std::memory_order_relaxed) != std::this_thread::get_id())
+            pool = nullptr;
+
+        block_header* header;
+
+        if (pool != nullptr && size_class < class_count)
+        {
+            header = header_of(pool->allocate_block(size_class));
+        }
+        else
+        {
+            if (pool != nullptr)
+                pool->counters.oversize_allocations++;
+
+            header = static_cast<block_header*>(::operator new(bytes + header_size));
+            header->pool = nullptr;
+            header->size_class = class_count;
+        }
+
+        return data_of(header);
+    }
+
+    inline void* event_pool::allocate_buffer()
+    {
+        event_pool* pool = current_event_pool();
+
+        if (pool != nullptr && pool->owner.load(std::memory_order_relaxed) == std::this_thread::get_id())
+            return pool->allocate_block(buffer_class);
+
+        block_header* header = static_cast<block_header*>(::operator new(header_size + buffer_bytes));
+        header->pool = nullptr;
+        header->size_class = buffer_class;
+
+        return data_of(header);
+    }
+
+    inline void event_pool::deallocate(void* ptr) noexcept
+    {
+        block_header* header = header_of(ptr);
+
+        if (header->pool == nullptr)
+            ::operator delete(header);
+        else
+            header->pool->release_block(header);
+    }
+}
+
+#endif
+/*
+    Copyright (c) 2021 Jari Ronkainen
+
+    This software is provided 'as-is', without any express or implied warranty.
+    In no event will the authors be held liable for any damages arising from the
+    use of this software.
+
+    Permission is granted to anyone to use this software for any purpose, including
+    commercial applications, and to alter it and redistribute it freely, subject to
+    the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not claim
+       that you wrote the original software. If you use this software in a product,
+       an acknowledgment in the product documentation would be appreciated but is
+       not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+       misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source distribution.
+*/
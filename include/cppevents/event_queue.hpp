@@ -1,12 +1,22 @@
 #ifndef LIBCPPEVENT_EVENT_QUEUE_HPP
 #define LIBCPPEVENT_EVENT_QUEUE_HPP
 
+#include <algorithm>
 #include <chrono>
+#include <coroutine>
 #include <memory>
+#include <memory_resource>
+#include <string_view>
+#include <vector>
 #include <experimental/propagate_const>
 
 #include "common.hpp"
 #include "event.hpp"
+#include "inline_function.hpp"
+
+#ifndef CPPEVENTS_CALLBACK_STORAGE_SIZE
+#define CPPEVENTS_CALLBACK_STORAGE_SIZE (6 * sizeof(void*))
+#endif
 
 namespace cppevents
 {
@@ -17,31 +27,209 @@ namespace cppevents
     using destructor_type = void(*)(native_source_type);
     // #endif
 
+    // batch translators append any number of events per readiness
+    // to a buffer owned by the queue
+    using event_buffer = std::vector<raw_event>;
+    using batch_translator_type = void(*)(native_source_type, event_buffer&);
+
+    /*!
+     *  \brief  How readiness of a native source is reported
+     *
+     *  With edge triggering the translator is only called again once new
+     *  data arrives, so it must read the source until it would block.
+     *  Pairs well with batch translators.
+     *
+     *  Exclusive is level triggered, but when several queues watch the
+     *  same descriptor only one of them is woken for each readiness, as
+     *  wanted for a listening socket shared by the queues of a group.
+     */
+    enum class trigger_mode
+    {
+        level,
+        edge,
+        exclusive,
+    };
+
+    struct queue_statistics
+    {
+        // events sent from other threads, and how many times those
+        // actually had to wake up the queue
+        uint64_t remote_events = 0;
+        uint64_t remote_wakeups = 0;
+
+        // wakeups that filled the whole ready list, and its current size
+        uint64_t full_batches = 0;
+        uint32_t batch_size = 0;
+
+        // system calls made to wait for readiness, epoll_wait or
+        // io_uring_enter depending on the backend
+        uint64_t poll_calls = 0;
+
+        // wakeups of the timerfd that fired timers, and timer expiries
+        // that would have needed a wakeup of their own without slack
+        uint64_t timer_wakeups = 0;
+        uint64_t timer_wakeups_saved = 0;
+
+        // large events served from the pool of the queue, slabs taken
+        // from the memory resource, events too large for the pool, and
+        // pool blocks freed by other threads
+        uint64_t pool_allocations = 0;
+        uint64_t pool_slab_allocations = 0;
+        uint64_t pool_oversize_allocations = 0;
+        uint64_t pool_remote_frees = 0;
+
+        // receive buffers taken from the event pool of the queue, slabs
+        // of them taken from the memory resource, and buffers returned
+        // by other threads
+        uint64_t buffer_allocations = 0;
+        uint64_t buffer_slab_allocations = 0;
+        uint64_t buffer_remote_frees = 0;
+    };
+
+    namespace detail
+    {
+        // suspended coroutines are linked to the queue through these,
+        // they live in the coroutine frames so waiting never allocates
+        struct event_waiter
+        {
+            std::coroutine_handle<> handle;
+            event_waiter* next = nullptr;
+            raw_event* event = nullptr;
+        };
+
+        struct readiness_waiter
+        {
+            std::coroutine_handle<> handle;
+        };
+
+        struct deadline_waiter
+        {
+            std::coroutine_handle<> handle;
+            std::chrono::steady_clock::time_point deadline;
+        };
+
+        template <typename T> class next_event_awaiter;
+
+        // deadline a timeout from now ends at, negative timeouts and those
+        // too long for the clock never end
+        template <typename Rep, typename Period>
+        std::chrono::steady_clock::time_point deadline_after(std::chrono::duration<Rep, Period> timeout) noexcept
+        {
+            using clock = std::chrono::steady_clock;
+
+            if (timeout < timeout.zero())
+                return clock::time_point::max();
+
+            const clock::time_point now = clock::now();
+            if (std::chrono::duration<double>(timeout) >= std::chrono::duration<double>(clock::time_point::max() - now))
+                return clock::time_point::max();
+
+            return now + std::chrono::ceil<clock::duration>(timeout);
+        }
+    }
+
+    struct timer;
+
     class event_queue
     {
         public:
-            using callback_type = std::function<void(raw_event&)>;
+            using callback_type = inline_function<void(raw_event&), CPPEVENTS_CALLBACK_STORAGE_SIZE>;
+
+            // a task may carry an event and a pointer or two along with it,
+            // e.g. to an offloaded handler, whatever the inline size and
+            // alignment of raw_event
+            static constexpr std::size_t task_storage_align = std::max(alignof(std::max_align_t), alignof(raw_event));
+            static constexpr std::size_t task_storage_size = std::max<std::size_t>(
+                2 * CPPEVENTS_CALLBACK_STORAGE_SIZE,
+                (2 * sizeof(void*) + alignof(raw_event) - 1) / alignof(raw_event) * alignof(raw_event) + sizeof(raw_event));
+
+            using task_type = inline_function<void(), task_storage_size, task_storage_align>;
 
             event_queue() noexcept;
             ~event_queue();
 
-            void bind_group_to_func(event_details::id_type, callback_type) noexcept;
-            void bind_event_to_func(event_details::id_type, callback_type) noexcept;
+            // the name of the type is optional, when given binding another
+            // type with the same id fails with error_code::already_exists
+            error_code bind_group_to_func(event_details::id_type, callback_type, std::string_view = {}) noexcept;
+            error_code bind_event_to_func(event_details::id_type, callback_type, std::string_view = {}) noexcept;
+
+            // wait until something has been handled, or the timeout or the
+            // deadline has passed.  timeouts have nanosecond resolution
+            // and are measured with the steady clock
+            void wait() { wait(std::chrono::steady_clock::time_point::max()); }
+            void wait(std::chrono::steady_clock::time_point deadline);
+
+            template <typename Rep, typename Period>
+            void wait(std::chrono::duration<Rep, Period> timeout) { wait(detail::deadline_after(timeout)); }
 
-            void wait(std::chrono::milliseconds timeout = std::chrono::milliseconds(-1));
             void poll();
 
+            // handled immediately when called from the thread running the
+            // queue, from other threads the event is handed to that thread
+            // and handled on its next wait() or poll()
             template <typename EventType>
             void send_event(EventType ev) { return send_event(get_event_details_for<EventType>(), ev); }
             void send_event(event_details, raw_event);
 
+            // posted events are queued and handled in order on the next
+            // wait() or poll(), from the thread running the queue
+            template <typename EventType>
+            void post_event(EventType ev) { return post_event(get_event_details_for<EventType>(), std::move(ev)); }
+            void post_event(event_details, raw_event);
+
+            // run a function on the thread running the queue, right away
+            // when already there, otherwise on its next wakeup
+            void execute(task_type);
+
+            queue_statistics statistics() const noexcept;
+
+            // number of ready sources handled per wakeup, 16 by default.
+            // giving a larger max_size makes it adapt to the load
+            void set_batch_size(uint32_t size, uint32_t max_size = 0) noexcept;
+
+            // upstream for the slabs large events and receive buffers are
+            // allocated from, nullptr restores the default new/delete resource
+            void set_memory_resource(std::pmr::memory_resource*) noexcept;
+
             
-            // for adding new events
-            error_code add_native_source(native_source_type, translator_type, destructor_type = nullptr);
+            // for adding new events.  a descriptor still registered is
+            // refused with error_code::already_exists, one closed without
+            // removing it may be added again once its number is reused
+            error_code add_native_source(native_source_type, translator_type, destructor_type = nullptr, trigger_mode = trigger_mode::level);
+            error_code add_native_source(native_source_type, batch_translator_type, destructor_type = nullptr, trigger_mode = trigger_mode::level);
             void remove_native_source(native_source_type);
 
-        private:
+            // timers of a queue share a single timerfd and fire with a
+            // resolution of a millisecond.  adding a timer with the id of
+            // a running one restarts it with the new settings
+            error_code add_timer(const timer&);
+            bool cancel_timer(int timer_id);
+
+            // signals are read from a signalfd of the queue, all pending
+            // ones on every wakeup.  a signal is blocked in the thread
+            // adding it, other threads must block it as well or it may be
+            // delivered to them the usual way
+            error_code add_signal(int signal);
+            bool remove_signal(int signal);
+
+            // awaitable for the next event of type T, see coroutine.hpp
+            template <typename T>
+            detail::next_event_awaiter<T> next() noexcept;
+
+            // coroutine support, used by the awaitables in coroutine.hpp.
+            // waiters are resumed from wait() or poll(), a queue destroyed
+            // with coroutines still waiting on it destroys them too
+            void await_event(event_details::id_type, detail::event_waiter&);
+            void await_deadline(detail::deadline_waiter&);
+
+            // false when the descriptor is ready already, which is only
+            // reported once per edge, or it could not be watched
+            bool await_readable(native_source_type, detail::readiness_waiter&, error_code&);
+
+            // derived from by the polling backends
             class implementation;
+
+        private:
             std::experimental::propagate_const<std::unique_ptr<implementation>> impl;
     };
 
@@ -51,10 +239,13 @@ namespace cppevents
     template <typename Source_Tag, typename T> requires std::is_fundamental<T>::value || std::is_pointer<T>::value
     error_code add_source(T, event_queue& = default_queue);
 
-    template <typename Source_tag, typename T> requires (not std::is_pointer<T>::value)
+    // descriptors, signal numbers and the like are taken by value only,
+    // the reference overloads would make every call with them ambiguous
+    template <typename Source_tag, typename T> requires (not std::is_pointer<T>::value) && (not std::is_fundamental<T>::value)
     error_code add_source(T&, event_queue& = default_queue);
 
     template <typename Source_tag, typename T> requires (not std::is_pointer<T>::value) && (not std::is_lvalue_reference<T>::value)
+                                                         && (not std::is_fundamental<std::remove_reference_t<T>>::value)
     error_code add_source(T&&, event_queue& = default_queue);
 
     template <typename T>
@@ -62,25 +253,107 @@ namespace cppevents
         return add_source<source::unspecified>(std::forward<T>(t), eq);
     }
 
+    namespace detail
+    {
+        // Parameter of a handler with a single, non-template call operator,
+        // void for generic lambdas and everything else
+        template <typename R, typename A> A handler_parameter(R (*)(A));
+        template <typename R, typename A> A handler_parameter(R (*)(A) noexcept);
+        template <typename R, typename C, typename A> A handler_parameter(R (C::*)(A));
+        template <typename R, typename C, typename A> A handler_parameter(R (C::*)(A) const);
+        template <typename R, typename C, typename A> A handler_parameter(R (C::*)(A) noexcept);
+        template <typename R, typename C, typename A> A handler_parameter(R (C::*)(A) const noexcept);
+
+        template <typename Func>
+        struct handler_parameter_of
+        {
+            using type = void;
+        };
+
+        template <typename Func> requires std::is_pointer_v<Func>
+        struct handler_parameter_of<Func>
+        {
+            using type = decltype(handler_parameter(std::declval<Func>()));
+        };
+
+        template <typename Func> requires requires { &Func::operator(); }
+        struct handler_parameter_of<Func>
+        {
+            using type = decltype(handler_parameter(&Func::operator()));
+        };
+
+        // T converts to raw_event, so a handler taking a raw_event is also
+        // invocable with T& and must not be mistaken for a typed one
+        template <typename Func>
+        constexpr bool takes_raw_event = std::is_same_v<std::remove_cvref_t<typename handler_parameter_of<Func>::type>, raw_event>;
+
+        /*!
+         *  \brief  Wrap a handler into a callback bound to event type T
+         *
+         *  Handlers taking T& or const T& get a reference straight into the
+         *  event storage.  The queue only calls the callback for events with
+         *  the id of T, so the type check is done once, here, when binding.
+         *  Handlers taking a raw_event get the event itself.
+         */
+        template <typename T, typename Func>
+        event_queue::callback_type make_callback(Func&& func)
+        {
+            using func_type = std::decay_t<Func>;
+
+            // a null handler is bound as an empty callback, not wrapped
+            if constexpr (std::is_pointer_v<func_type>) {
+                if (func == nullptr)
+                    return nullptr;
+            }
+
+            if constexpr (not is_group<T>::value && not takes_raw_event<func_type> && std::is_invocable_v<func_type&, T&>) {
+                return [f = std::forward<Func>(func)](raw_event& ev) mutable {
+                    f(unchecked_event_cast<T>(ev));
+                };
+            } else {
+                static_assert(std::is_invocable_v<func_type&, raw_event&>,
+                              "event handler must accept raw_event& or const raw_event&, or T& / const T& for a single event type");
+                return event_queue::callback_type(std::forward<Func>(func));
+            }
+        }
+    }
+
     // Acting on events
-    template <typename T, typename... Types>
-    void on_event(event_queue::callback_type func, event_queue& = default_queue) {
+    //
+    // When binding several types at once, every binding gets its own copy
+    // of the callable, the last one takes the original.
+    template <typename T, typename... Types, typename Func>
+    error_code on_event(Func&& func, event_queue& queue = default_queue) {
+        if constexpr (sizeof...(Types) > 0) {
+            error_code rval = on_event<Types...>(func, queue);
+            if (rval != error_code::success)
+                return rval;
+        }
+
         if constexpr(is_group<T>::value) {
-            default_queue.bind_group_to_func(get_event_group_id_for<T>(), func);
+            return queue.bind_group_to_func(get_event_group_id_for<T>(),
+                                            detail::make_callback<T>(std::forward<Func>(func)),
+                                            detail::type_name<T>());
         } else {
-            default_queue.bind_event_to_func(get_event_details_for<T>().event_id, func);
+            return queue.bind_event_to_func(get_event_details_for<T>().event_id,
+                                            detail::make_callback<T>(std::forward<Func>(func)),
+                                            detail::type_name<T>());
         }
-
-        if constexpr (sizeof...(Types) > 0)
-            on_event<Types...>(func);
     }
 
-    inline void wait(std::chrono::milliseconds timeout = std::chrono::milliseconds(-1)) { default_queue.wait(timeout); }
+    inline void wait() { default_queue.wait(); }
+    inline void wait(std::chrono::steady_clock::time_point deadline) { default_queue.wait(deadline); }
+
+    template <typename Rep, typename Period>
+    void wait(std::chrono::duration<Rep, Period> timeout) { default_queue.wait(timeout); }
     inline void poll() { default_queue.poll(); }
 
     // Sending events
     template <typename EventType>
     inline void send_event(EventType ev) { return default_queue.send_event(get_event_details_for<EventType>(), std::move(ev)); }
+
+    template <typename EventType>
+    inline void post_event(EventType ev) { return default_queue.post_event(get_event_details_for<EventType>(), std::move(ev)); }
 }
 
 #endif
@@ -0,0 +1,192 @@
+/*!
+ *  \file       event_queue_group.hpp
+ *  \brief      thread-per-core group of event queues
+ *  \author     Jari Ronkainen
+ *  \version    0.1
+ */
+#ifndef LIBCPPEVENTS_EVENT_QUEUE_GROUP_HPP
+#define LIBCPPEVENTS_EVENT_QUEUE_GROUP_HPP
+
+#include <atomic>
+#include <cassert>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "event_queue.hpp"
+
+namespace cppevents
+{
+    //! How a native source added to a group picks its shard
+    enum class shard_policy
+    {
+        round_robin,
+        least_loaded,
+        explicit_shard,
+    };
+
+    /*!
+     *  \brief  A set of event queues, each run by its own thread
+     *
+     *  Every shard is an ordinary event_queue created and run on a thread
+     *  of its own, optionally pinned to a CPU.  Native sources are spread
+     *  over the shards, handlers bound through the group are bound on every
+     *  shard.  Everything touching a shard is done on its own thread, so
+     *  these can be called while the group is running.
+     */
+    class event_queue_group
+    {
+        public:
+            //! shards = 0 uses one shard per hardware thread
+            explicit event_queue_group(std::size_t shards = 0, bool pin_threads = true);
+            ~event_queue_group();
+
+            event_queue_group(const event_queue_group&) = delete;
+            event_queue_group& operator=(const event_queue_group&) = delete;
+
+            std::size_t size() const noexcept { return shards.size(); }
+            event_queue& shard(std::size_t index) noexcept { return *shards[index]->queue; }
+
+            //! Number of native sources the group has on a shard
+            std::size_t load(std::size_t index) const noexcept { return shards[index]->sources.load(std::memory_order_relaxed); }
+
+            /*!
+             *  \brief  Add a native source to one of the shards
+             *
+             *  \param  shard_index shard to use with shard_policy::explicit_shard
+             *
+             *  \return error_code from the shard, the shard used is written
+             *          to chosen if it is not null
+             */
+            template <typename Translator>
+            error_code add_native_source(native_source_type fd,
+                                         Translator translator,
+                                         destructor_type destructor = nullptr,
+                                         trigger_mode mode = trigger_mode::level,
+                                         shard_policy policy = shard_policy::round_robin,
+                                         std::size_t shard_index = 0,
+                                         std::size_t* chosen = nullptr)
+            {
+                const std::size_t index = pick_shard(policy, shard_index);
+
+                error_code rval = run_on(index, [&] {
+                    return shard(index).add_native_source(fd, translator, destructor, mode);
+                });
+
+                if (rval == error_code::success)
+                    track_source(fd, index);
+                if (chosen != nullptr)
+                    *chosen = index;
+
+                return rval;
+            }
+
+            /*!
+             *  \brief  Remove a native source added through the group
+             *
+             *  Done on the thread of the shard it was added to, which is
+             *  waited for like with add_native_source.
+             */
+            void remove_native_source(native_source_type fd);
+
+            //! Bind a handler on every shard, each gets its own copy
+            template <typename T, typename... Types, typename Func>
+            error_code on_event(Func&& func)
+            {
+                for (std::size_t i = 0; i < size(); ++i)
+                {
+                    error_code rval = run_on(i, [&] {
+                        return cppevents::on_event<T, Types...>(func, shard(i));
+                    });
+
+                    if (rval != error_code::success)
+                        return rval;
+                }
+                return error_code::success;
+            }
+
+            /*!
+             *  \brief  Run a function on the thread of a shard and wait for it
+             *
+             *  May be called from any thread but the one of another shard:
+             *  two shards waiting for each other would never wake up.  The
+             *  same goes for everything here that runs on a shard.
+             *
+             *  \return whatever the function returned
+             */
+            template <typename Func>
+            std::invoke_result_t<Func&> run_on(std::size_t index, Func&& func)
+            {
+                using result_type = std::invoke_result_t<Func&>;
+
+                assert(not on_other_shard(index));
+
+                std::promise<result_type> result;
+
+                shard(index).execute([&] {
+                    if constexpr (std::is_void_v<result_type>) {
+                        func();
+                        result.set_value();
+                    } else {
+                        result.set_value(func());
+                    }
+                });
+
+                return result.get_future().get();
+            }
+
+            //! Stop and join every shard thread, called by the destructor
+            void stop();
+
+        private:
+            struct shard_state
+            {
+                std::unique_ptr<event_queue> queue;
+                std::thread thread;
+                std::thread::id thread_id;
+                std::atomic<std::size_t> sources = 0;
+                bool stopping = false;
+            };
+
+            std::size_t pick_shard(shard_policy policy, std::size_t requested) noexcept;
+
+            // whether the calling thread runs a shard other than index
+            bool on_other_shard(std::size_t index) const noexcept;
+
+            // shard of every native source added through the group
+            void track_source(native_source_type fd, std::size_t index);
+
+            std::vector<std::unique_ptr<shard_state>> shards;
+            std::atomic<std::size_t> next_shard = 0;
+
+            std::mutex sources_lock;
+            std::unordered_map<native_source_type, std::size_t> source_shards;
+    };
+}
+
+#endif
+/*
+    Copyright (c) 2021 Jari Ronkainen
+
+    This software is provided 'as-is', without any express or implied warranty.
+    In no event will the authors be held liable for any damages arising from the
+    use of this software.
+
+    Permission is granted to anyone to use this software for any purpose, including
+    commercial applications, and to alter it and redistribute it freely, subject to
+    the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not claim
+       that you wrote the original software. If you use this software in a product,
+       an acknowledgment in the product documentation would be appreciated but is
+       not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+       misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source distribution.
+*/
@@ -0,0 +1,181 @@
+/*!
+ *  \file       executor.hpp
+ *  \brief      work-stealing thread pool for offloaded event handlers
+ *  \author     Jari Ronkainen
+ *  \version    0.1
+ */
+#ifndef LIBCPPEVENTS_EXECUTOR_HPP
+#define LIBCPPEVENTS_EXECUTOR_HPP
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "event_queue.hpp"
+
+namespace cppevents
+{
+    /*!
+     *  \brief  Pool of worker threads with one task deque per worker
+     *
+     *  Tasks submitted from outside the pool are dealt to the workers in
+     *  turn, tasks submitted by a worker go to its own deque.  Workers take
+     *  from the front of their own deque and steal from the back of the
+     *  others when they run dry, so a worker stuck in a slow task does not
+     *  hold back the tasks queued behind it.  Idle workers sleep until
+     *  there is work.
+     */
+    class executor
+    {
+        public:
+            using task_type = event_queue::task_type;
+
+            //! workers = 0 uses one worker per hardware thread
+            explicit executor(std::size_t workers = 0);
+
+            //! Runs all submitted tasks before returning
+            ~executor();
+
+            executor(const executor&) = delete;
+            executor& operator=(const executor&) = delete;
+
+            void submit(task_type);
+
+            std::size_t size() const noexcept { return workers.size(); }
+
+            //! Number of tasks run by a worker other than the one given them
+            uint64_t steals() const noexcept { return stolen.load(std::memory_order_relaxed); }
+
+        private:
+            struct alignas(64) worker
+            {
+                std::mutex lock;
+                std::deque<task_type> tasks;
+                std::thread thread;
+            };
+
+            void run(std::size_t index);
+            bool take(std::size_t index, task_type& task);
+
+            std::vector<std::unique_ptr<worker>> workers;
+
+            // tasks in the deques and workers sleeping on that count
+            std::atomic<uint32_t> pending = 0;
+            std::atomic<uint32_t> sleepers = 0;
+
+            std::atomic<std::size_t> next_worker = 0;
+            std::atomic<uint64_t> stolen = 0;
+            std::atomic<bool> stopping = false;
+    };
+
+    //! Ordering kept between events given to an offloaded handler
+    enum class offload_order
+    {
+        // events may be handled concurrently and in any order
+        unordered,
+        // events of the bound type are handled one at a time, in order
+        per_type,
+    };
+
+    /*!
+     *  \brief  Run a handler on an executor instead of the queue thread
+     *
+     *  Passed to on_event.  The queue thread only waits and translates,
+     *  the event itself is moved to a worker, so an offloaded handler should
+     *  be the last one interested in it: a handler bound to the group of
+     *  the type is not called for events an offloaded handler took.  An
+     *  unordered handler may be running on several workers at once.
+     */
+    struct offload
+    {
+        executor& workers;
+        offload_order order = offload_order::unordered;
+    };
+
+    namespace detail
+    {
+        // owns the handler of an offloaded binding, shared with the
+        // tasks still in flight
+        class offloaded_handler : public std::enable_shared_from_this<offloaded_handler>
+        {
+            public:
+                offloaded_handler(executor& workers, event_queue::callback_type callback) noexcept
+                    : workers{workers}, callback{std::move(callback)} {}
+
+                void handle(raw_event&& ev);
+                void handle_ordered(raw_event&& ev);
+
+            private:
+                void drain();
+
+                executor& workers;
+                event_queue::callback_type callback;
+
+                // per_type ordering: events wait here while one worker
+                // goes through them
+                std::mutex lock;
+                std::deque<raw_event> backlog;
+                bool draining = false;
+        };
+
+        template <typename T, typename Func>
+        event_queue::callback_type make_offloaded_callback(Func&& func, offload policy)
+        {
+            auto handler = std::make_shared<offloaded_handler>(policy.workers, make_callback<T>(std::forward<Func>(func)));
+
+            if (policy.order == offload_order::per_type) {
+                return [handler](raw_event& ev) { handler->handle_ordered(std::move(ev)); };
+            } else {
+                return [handler](raw_event& ev) { handler->handle(std::move(ev)); };
+            }
+        }
+    }
+
+    // Acting on events on worker threads
+    //
+    // With several types each type gets its own ordering.
+    template <typename T, typename... Types, typename Func>
+    error_code on_event(Func&& func, offload policy, event_queue& queue = default_queue) {
+        if constexpr (sizeof...(Types) > 0) {
+            error_code rval = on_event<Types...>(func, policy, queue);
+            if (rval != error_code::success)
+                return rval;
+        }
+
+        if constexpr(is_group<T>::value) {
+            return queue.bind_group_to_func(get_event_group_id_for<T>(),
+                                            detail::make_offloaded_callback<T>(std::forward<Func>(func), policy),
+                                            detail::type_name<T>());
+        } else {
+            return queue.bind_event_to_func(get_event_details_for<T>().event_id,
+                                            detail::make_offloaded_callback<T>(std::forward<Func>(func), policy),
+                                            detail::type_name<T>());
+        }
+    }
+}
+
+#endif
+/*
+    Copyright (c) 2021 Jari Ronkainen
+
+    This software is provided 'as-is', without any express or implied warranty.
+    In no event will the authors be held liable for any damages arising from the
+    use of this software.
+
+    Permission is granted to anyone to use this software for any purpose, including
+    commercial applications, and to alter it and redistribute it freely, subject to
+    the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not claim
+       that you wrote the original software. If you use this software in a product,
+       an acknowledgment in the product documentation would be appreciated but is
+       not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+       misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source distribution.
+*/
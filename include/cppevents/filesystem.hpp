@@ -1,13 +1,135 @@
+/*!
+ *  \file       filesystem.hpp
+ *  \brief      filesystem event types for libcppevents
+ *  \author     Jari Ronkainen
+ *  \version    0.3
+ */
 #ifndef LIBCPPEVENTS_FILESYSTEM_HPP
 #define LIBCPPEVENTS_FILESYSTEM_HPP
 
 #include "event_queue.hpp"
 
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include <experimental/propagate_const>
+
 namespace cppevents
 {
+    /*!
+     *  \brief  Changes to an entry of a watched directory
+     *
+     *  Everything that happened to the same entry between two wakeups of
+     *  the queue is merged into a single event, so changes may have
+     *  several bits set.
+     *
+     *  The directory and name point into storage of the watcher that is
+     *  reused on its next wakeup, they are only valid while the handler
+     *  runs.  Copy them, e.g. with path(), to keep them.  A handler
+     *  offloaded to an executor runs too late to read them.
+     */
     struct filesystem_event
     {
+        enum change : uint32_t
+        {
+            created     = 1 << 0,
+            modified    = 1 << 1,
+            attributes  = 1 << 2,
+            deleted     = 1 << 3,
+            moved_from  = 1 << 4,
+            moved_to    = 1 << 5,
+
+            // events were lost, the state of the tree should be rescanned
+            overflow    = 1 << 6,
+        };
+
+        uint32_t changes = 0;
+        bool is_directory = false;
+
+        // the directory, and the entry in it, empty for the directory itself
+        const char* directory = "";
+        const char* name = "";
+
+        std::string path() const
+        {
+            std::string rval = directory;
+            if (*name != '\0')
+                rval.append("/").append(name);
+            return rval;
+        }
+    };
+
+    //! Kernel interface a filesystem_watcher is built on
+    enum class filesystem_backend
+    {
+        // a watch per directory, set up by walking the tree
+        inotify,
+        // a mark per filesystem, events filtered to the watched trees.
+        // Needs CAP_SYS_ADMIN and CAP_DAC_READ_SEARCH, without them the
+        // watcher falls back to inotify
+        fanotify,
+    };
+
+    /*!
+     *  \brief  Source of filesystem_events for whole directory trees
+     *
+     *  Directories added with recursive watching have their subdirectories
+     *  watched as well, including the ones created later.  Everything is
+     *  delivered to the queue given to the constructor, and the watcher
+     *  must be used and destroyed on the thread running it.
+     *
+     *  The inotify backend watches every directory of a tree, so a large
+     *  tree takes a while to set up and a watch per directory.  fanotify
+     *  marks the filesystem once and costs the same for any tree, but
+     *  reports every change on the filesystem for the watcher to filter,
+     *  and its directories are always canonical absolute paths.
+     */
+    class filesystem_watcher
+    {
+        public:
+            explicit filesystem_watcher(event_queue& queue = default_queue,
+                                        filesystem_backend backend = filesystem_backend::inotify);
+            ~filesystem_watcher();
+
+            filesystem_watcher(const filesystem_watcher&) = delete;
+            filesystem_watcher& operator=(const filesystem_watcher&) = delete;
+
+            // fails with the error the watcher was set up with, if any
+            error_code watch(std::string_view path, bool recursive = true);
+
+            //! Number of directories watched, or of marks with fanotify
+            std::size_t size() const noexcept;
+
+            //! The backend in use, which may not be the one asked for
+            filesystem_backend backend() const noexcept;
+
+            class implementation;
+
+        private:
+            std::experimental::propagate_const<std::unique_ptr<implementation>> impl;
     };
 }
 
 #endif
+/*
+    Copyright (c) 2021 Jari Ronkainen
+
+    This software is provided 'as-is', without any express or implied warranty.
+    In no event will the authors be held liable for any damages arising from the
+    use of this software.
+
+    Permission is granted to anyone to use this software for any purpose, including
+    commercial applications, and to alter it and redistribute it freely, subject to
+    the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not claim
+       that you wrote the original software. If you use this software in a product,
+       an acknowledgment in the product documentation would be appreciated but is
+       not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+       misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source distribution.
+*/
@@ -0,0 +1,181 @@
+/*!
+ *  \file       inline_function.hpp
+ *  \brief      move-only callable wrapper with inline storage
+ *  \author     Jari Ronkainen
+ *  \version    0.1
+ */
+#ifndef LIBCPPEVENTS_INLINE_FUNCTION_HPP
+#define LIBCPPEVENTS_INLINE_FUNCTION_HPP
+
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace cppevents
+{
+    namespace detail
+    {
+        enum class function_action
+        {
+            destroy,
+            move,
+        };
+
+        using function_manager_ptr = void (*)(function_action, void*, void*);
+    }
+
+    template <typename Signature, std::size_t Capacity = 6 * sizeof(void*), std::size_t Align = alignof(std::max_align_t)>
+    class inline_function;
+
+    /*!
+     *  \brief  Move-only replacement for std::function that never allocates
+     *
+     *  The callable is always stored in the object itself, a callable that
+     *  does not fit in Capacity bytes is a compile-time error.  Calling
+     *  goes through a single function pointer, moving and destroying
+     *  trivially copyable callables (most lambdas that capture by reference)
+     *  is a plain memcpy.  A null function pointer makes an empty one,
+     *  calling an empty inline_function is undefined.
+     */
+    template <typename R, typename... Arguments, std::size_t Capacity, std::size_t Align>
+    class inline_function<R(Arguments...), Capacity, Align>
+    {
+        public:
+            inline_function() noexcept = default;
+            inline_function(std::nullptr_t) noexcept {}
+
+            template <typename F, typename T = std::decay_t<F>>
+                requires (not std::is_same_v<T, inline_function>) && std::is_invocable_r_v<R, T&, Arguments...>
+            inline_function(F&& func)
+            {
+                static_assert(sizeof(T) <= Capacity, "callable does not fit in inline_function storage, capture less or increase the capacity");
+                static_assert(alignof(T) <= Align, "callable is over-aligned for inline_function storage");
+                static_assert(std::is_nothrow_move_constructible_v<T>, "callables stored in inline_function must be nothrow move constructible");
+
+                if constexpr (std::is_pointer_v<T>) {
+                    if (func == nullptr)
+                        return;
+                }
+
+                ::new (static_cast<void*>(&storage)) T(std::forward<F>(func));
+                invoker = &invoke<T>;
+
+                if constexpr (not (std::is_trivially_copyable_v<T> && std::is_trivially_destructible_v<T>))
+                    manager = &manage<T>;
+            }
+
+            inline_function(const inline_function&) = delete;
+            inline_function(inline_function&& other) noexcept
+            {
+                take(other);
+            }
+
+            ~inline_function()
+            {
+                reset();
+            }
+
+            inline_function& operator=(const inline_function&) = delete;
+            inline_function& operator=(inline_function&& other) noexcept
+            {
+                if (this != &other)
+                {
+                    reset();
+                    take(other);
+                }
+                return *this;
+            }
+
+            inline_function& operator=(std::nullptr_t) noexcept
+            {
+                reset();
+                return *this;
+            }
+
+            R operator()(Arguments... args)
+            {
+                assert(invoker != nullptr);
+                return invoker(static_cast<void*>(&storage), std::forward<Arguments>(args)...);
+            }
+
+            explicit operator bool() const noexcept { return invoker != nullptr; }
+
+            static constexpr std::size_t capacity() noexcept { return Capacity; }
+
+        private:
+            using invoker_ptr = R (*)(void*, Arguments&&...);
+
+            template <typename T>
+            static R invoke(void* callable, Arguments&&... args)
+            {
+                return (*static_cast<T*>(callable))(std::forward<Arguments>(args)...);
+            }
+
+            template <typename T>
+            static void manage(detail::function_action act, void* self, void* other)
+            {
+                switch(act)
+                {
+                    case detail::function_action::destroy:
+                        static_cast<T*>(self)->~T();
+                        return;
+                    case detail::function_action::move:
+                        ::new (other) T(std::move(*static_cast<T*>(self)));
+                        static_cast<T*>(self)->~T();
+                        return;
+                }
+            }
+
+            void take(inline_function& other) noexcept
+            {
+                if (other.manager != nullptr)
+                    other.manager(detail::function_action::move, &other.storage, &storage);
+                else if (other.invoker != nullptr)
+                    std::memcpy(&storage, &other.storage, Capacity);
+
+                invoker = other.invoker;
+                manager = other.manager;
+                other.invoker = nullptr;
+                other.manager = nullptr;
+            }
+
+            void reset() noexcept
+            {
+                if (manager != nullptr)
+                    manager(detail::function_action::destroy, &storage, nullptr);
+                invoker = nullptr;
+                manager = nullptr;
+            }
+
+            alignas(Align) std::byte storage[Capacity];
+
+            invoker_ptr invoker = nullptr;
+            detail::function_manager_ptr manager = nullptr;
+    };
+}
+
+#endif
+/*
+    Copyright (c) 2021 Jari Ronkainen
+
+    This software is provided 'as-is', without any express or implied warranty.
+    In no event will the authors be held liable for any damages arising from the
+    use of this software.
+
+    Permission is granted to anyone to use this software for any purpose, including
+    commercial applications, and to alter it and redistribute it freely, subject to
+    the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not claim
+       that you wrote the original software. If you use this software in a product,
+       an acknowledgment in the product documentation would be appreciated but is
+       not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+       misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source distribution.
+*/
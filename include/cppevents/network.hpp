@@ -2,19 +2,35 @@
  *  \file       network.hpp
  *  \brief      network event types for libcppevents
  *  \author     Jari Ronkainen
- *  \version    0.6
+ *  \version    0.8
  *
  *  \todo Windows support
  */
 #ifndef LIBCPPEVENTS_NETWORK_HPP
 #define LIBCPPEVENTS_NETWORK_HPP
 
+#include "buffer_pool.hpp"
 #include "event_queue.hpp"
 
+#include <cstddef>
+#include <span>
 #include <string>
 
+#if defined (_WIN32)
+#include <winsock2.h>
+#else
+#include <sys/socket.h>
+#endif
+
 namespace cppevents
 {
+    /*!
+     *  \brief  Connections and data of sockets added as sources
+     *
+     *  Nothing in the event is allocated: the peer address is stored
+     *  inline, and received data stays in a buffer of the queue that is
+     *  kept for as long as some copy of the lease is.
+     */
     struct network_event
     {
         #if defined (_WIN32)
@@ -27,18 +43,58 @@ namespace cppevents
         enum subtype : unsigned int {
             new_connection,
             socket_ready,
-            connection_closed
+            connection_closed,
+            data_received,
+            // a listener could not accept, error tells why
+            accept_failed
         };
 
         subtype type;
 
-        std::string peer_address;
+        // set for new connections, AF_UNSPEC otherwise
+        sockaddr_storage peer_address{};
         uint16_t    peer_port = 0;
 
         native_socket_type sock_handle = -1;
+
+        // accept_failed: the errno of accept
+        int error = 0;
+
+        // data_received: the bytes read, valid while the buffer is held
+        std::span<const std::byte> data;
+        buffer_lease buffer;
+
+        //! peer_address as text, empty if there is none
+        std::string peer_name() const;
     };
 
+    /*!
+     *  \brief  Source tag for listening sockets
+     *
+     *      add_source<socket_listener>(listen_fd, queue);
+     *
+     *  Every connection pending when the socket becomes readable is
+     *  accepted at once, each one sent as a new_connection event with a
+     *  non-blocking, close-on-exec socket that the handler owns.  The
+     *  listener is made non-blocking.  The same listener may be added to
+     *  several queues, only one of them is woken for each readiness.
+     *
+     *  A failed accept is sent as accept_failed with the listener as the
+     *  socket.  When the process is out of descriptors, the pending
+     *  connections are taken with a descriptor held in reserve and closed
+     *  right away, the listener would stay readable otherwise.
+     */
     struct socket_listener { using event_type = network_event; };
+    /*!
+     *  \brief  Source tag for connected sockets
+     *
+     *      add_source<socket_io_event>(sock, queue);
+     *
+     *  Data is read into buffers from the pool of the queue and sent as
+     *  data_received events, a few buffers at most per wakeup.  The end
+     *  of the stream or an error is sent as connection_closed, and keeps
+     *  being sent until the socket is given to remove_native_source.
+     */
     struct socket_io_event { using event_type = network_event; };
 }
 
@@ -24,8 +24,11 @@ namespace cppevents
 {
     struct timer
     {
+        // slack lets the timer fire up to that much late, so that it
+        // can share a wakeup with other timers
         template <typename T> requires detail::is_duration<T>::value
-        constexpr timer(int id, T duration, int reps = -1) noexcept : id{id}, repeats{reps}
+        constexpr timer(int id, T duration, int reps = -1, std::chrono::nanoseconds slack = {}) noexcept
+            : id{id}, repeats{reps}, slack{slack}
         {
             auto nanosecs = std::chrono::duration_cast<std::chrono::nanoseconds>(duration);
             auto secs = std::chrono::duration_cast<std::chrono::seconds>(duration);
@@ -36,11 +39,20 @@ namespace cppevents
             seconds = secs.count();
         }
 
+        constexpr std::chrono::nanoseconds interval() const noexcept
+        {
+            return std::chrono::seconds(seconds) + std::chrono::nanoseconds(nanoseconds);
+        }
+
         uint64_t seconds = 0;
         uint64_t nanoseconds = 0;
 
         int id = 0;
+
+        // number of expirations before the timer stops, -1 for no end
         int repeats;
+
+        std::chrono::nanoseconds slack{};
     };
 }
 
@@ -22,9 +22,9 @@ namespace cppevents::detail
      *  \brief  Convert an SDL_Event to cppevents window event
      *
      *  Takes in a SDL_Event and translates it to cppevents
-     *  window event, and sends it to concerned entities
+     *  window event, and appends it to the events to be handled
      */
-    static void translate_sdl_window_event(SDL_Event& sdl_event)
+    static void translate_sdl_window_event(SDL_Event& sdl_event, event_buffer& events)
     {
         switch (sdl_event.window.event)
         {
@@ -32,7 +32,7 @@ namespace cppevents::detail
                 {
                     event::window_closed wevent;
                     wevent.window_id = sdl_event.window.windowID;
-                    send_event(wevent);
+                    events.emplace_back(wevent);
                     return;
                 }
             case SDL_WINDOWEVENT_SHOWN:
@@ -50,7 +50,7 @@ namespace cppevents::detail
                                   sdl_event.type == SDL_WINDOWEVENT_MAXIMIZED ? event::window_visibility::maximized :
                                   sdl_event.type == SDL_WINDOWEVENT_MINIMIZED ? event::window_visibility::minimized :
                                   event::window_visibility::restored;
-                    send_event(wevent);
+                    events.emplace_back(wevent);
                     return;
                 }
             case SDL_WINDOWEVENT_MOVED:
@@ -59,7 +59,7 @@ namespace cppevents::detail
                     wevent.window_id = sdl_event.window.windowID;
                     wevent.x = sdl_event.window.data1;
                     wevent.y = sdl_event.window.data2;
-                    send_event(wevent);
+                    events.emplace_back(wevent);
                     return;
                 }
             case SDL_WINDOWEVENT_RESIZED:
@@ -69,7 +69,7 @@ namespace cppevents::detail
                     wevent.window_id = sdl_event.window.windowID;
                     wevent.width = sdl_event.window.data1;
                     wevent.height = sdl_event.window.data2;
-                    send_event(wevent);
+                    events.emplace_back(wevent);
                     return;
                 }
             case SDL_WINDOWEVENT_ENTER:
@@ -80,7 +80,7 @@ namespace cppevents::detail
                     wevent.type = sdl_event.type == SDL_WINDOWEVENT_ENTER ?
                         event::window_mouse_status::entered :
                         event::window_mouse_status::exited;
-                    send_event(wevent);
+                    events.emplace_back(wevent);
                     return;
                 }
             case SDL_WINDOWEVENT_FOCUS_GAINED:
@@ -91,7 +91,7 @@ namespace cppevents::detail
                     wevent.type = sdl_event.type == SDL_WINDOWEVENT_FOCUS_GAINED ? event::window_focus_change::focus_gained :
                                   sdl_event.type == SDL_WINDOWEVENT_TAKE_FOCUS ? event::window_focus_change::focus_offered :
                                   event::window_focus_change::focus_lost;
-                    send_event(wevent);
+                    events.emplace_back(wevent);
                     return;
                 }
             case SDL_WINDOWEVENT_TAKE_FOCUS:
@@ -106,9 +106,9 @@ namespace cppevents::detail
      *  \brief  Convert an SDL_Event to cppevents input event
      *
      *  Takes in a SDL_Event and translates it to cppevents
-     *  input event, and sends it to concerned entities
+     *  input event, and appends it to the events to be handled
      */
-    static void translate_sdl_input_event(SDL_Event& sdl_event)
+    static void translate_sdl_input_event(SDL_Event& sdl_event, event_buffer& events)
     {
         switch (sdl_event.type)
         {
@@ -127,7 +127,7 @@ namespace cppevents::detail
                     {
                         std::cerr << "ERROR: unhandled key: " << sdl_event.key.keysym.scancode << "\n";
                     }
-                    send_event(kbevent);
+                    events.emplace_back(kbevent);
                     return;
                 }
             case SDL_MOUSEMOTION:
@@ -138,7 +138,7 @@ namespace cppevents::detail
                     mevent.y_pixels = sdl_event.motion.y;
                     mevent.x_relative = sdl_event.motion.xrel;
                     mevent.y_relative = sdl_event.motion.yrel;
-                    send_event(mevent);
+                    events.emplace_back(mevent);
                     return;
                 }
             case SDL_MOUSEBUTTONDOWN:
@@ -153,7 +153,7 @@ namespace cppevents::detail
                     mevent.click_count = sdl_event.button.clicks;
                     mevent.x_pixels = sdl_event.button.x;
                     mevent.y_pixels = sdl_event.button.y;
-                    send_event(mevent);
+                    events.emplace_back(mevent);
                     return;
                 }
             case SDL_FINGERMOTION:
@@ -161,7 +161,7 @@ namespace cppevents::detail
             case SDL_FINGERUP:
                 {
                     event::touch tevent{};
-                    send_event(tevent);
+                    events.emplace_back(tevent);
                     return;
                 }
             default:
@@ -170,16 +170,13 @@ namespace cppevents::detail
     }
 
     /*!
-     *  \brief  callback for SDL events
-     *  \return empty event
+     *  \brief  batch translator for SDL events
      *
-     *  The callback handles forwarding the event itself, and
-     *  as such, always returns an empty event to libcppevents.
-     *
-     *  This is less error-prone in cases where many events
-     *  are received in a small amount of time
+     *  Drains every pending SDL event on each wakeup, so bursts
+     *  of input are handled without extra round-trips through
+     *  the queue.
      */
-    raw_event create_sdl_event(native_source_type fd)
+    void create_sdl_events(native_source_type fd, event_buffer& events)
     {
         (void)fd;
 
@@ -189,7 +186,7 @@ namespace cppevents::detail
             switch (ev.type)
             {
                 case SDL_WINDOWEVENT:
-                    translate_sdl_window_event(ev);
+                    translate_sdl_window_event(ev, events);
                     continue;
                 case SDL_CONTROLLERAXISMOTION:
                 case SDL_CONTROLLERBUTTONDOWN:
@@ -214,7 +211,7 @@ namespace cppevents::detail
                 case SDL_MOUSEBUTTONUP:
                 case SDL_MOUSEWHEEL:
                 case SDL_MULTIGESTURE:
-                    translate_sdl_input_event(ev);
+                    translate_sdl_input_event(ev, events);
                     continue;
                 // TODO: Support IME
                 case SDL_TEXTINPUT:
@@ -228,7 +225,6 @@ namespace cppevents::detail
                     continue;
             }
         }
-        return empty_event{};
     }
 }
 
@@ -281,7 +277,7 @@ namespace cppevents
         event_queue& queue)
     {
         cppevents::native_source_type src = cppevents::get_sdl_event_source(window);
-        queue.add_native_source(src, cppevents::detail::create_sdl_event);
+        queue.add_native_source(src, cppevents::detail::create_sdl_events);
 
         return error_code::success;
     }
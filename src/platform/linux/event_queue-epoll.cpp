@@ -7,12 +7,18 @@
  *  linux/epoll
  *
  */
-#include <cppevents/event_queue.hpp>
+#include "queue_implementation.hpp"
 
-#include <unordered_map>
+#include <algorithm>
+#include <cerrno>
+#include <limits>
+#include <vector>
 
 #include <sys/epoll.h>
-#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+
+#include <linux/time_types.h>
 
 #include <unistd.h>
 
@@ -22,196 +28,304 @@ using namespace std::chrono_literals;
 
 namespace cppevents
 {
-    class event_queue::implementation
+    namespace
     {
-        public:
-            implementation();
-            ~implementation();
+        class epoll_queue final : public event_queue::implementation
+        {
+            public:
+                epoll_queue();
+                ~epoll_queue();
+
+                void wait(std::chrono::steady_clock::time_point deadline, bool block = true) noexcept override;
+
+            private:
+                bool watch_source(native_source_type fd, const source_record& source) noexcept override;
+                void unwatch_source(native_source_type fd, const source_record& source) noexcept override;
+                bool release_stale_source(native_source_type fd, const source_record& stale) noexcept override;
+                bool watch_internal(int fd, uint64_t data) noexcept override;
+
+                // epoll_pwait2 takes a timespec, on kernels older than 5.11
+                // timeouts finer than a millisecond go through a timerfd
+                int poll_events(epoll_event* events, int max_events, std::chrono::nanoseconds timeout) noexcept;
+
+                static constexpr uint64_t wait_timer_data = ~uint64_t(2);
+
+                // the set knows a descriptor together with its open file,
+                // and closing the descriptor only takes it out once no
+                // duplicate keeps the file open.  when removal finds the
+                // number closed or given to another file, the old entry
+                // may be left behind where nothing can delete it, and its
+                // readiness comes back tagged with a stale generation.
+                // the set is then built again from the sources still live
+                void rebuild_set() noexcept;
+                bool may_have_orphans = false;
+
+                bool has_pwait2 = true;
+                int wait_timer_fd = -1;
+
+                // ready list handed to epoll_wait, kept at the largest
+                // batch size ever used
+                std::vector<epoll_event> ready_events;
+
+                int epoll_fd = -1;
+        };
+    }
 
-            void bind_event_to_func(event_details::id_type, callback_type, bool = false) noexcept;
+    event_queue::event_queue() noexcept : impl(std::make_unique<epoll_queue>()) {}
 
-            void wait(std::chrono::milliseconds timeout, bool block = true) noexcept;
+    epoll_queue::epoll_queue()
+    {
+        ready_events.resize(batch_size);
 
-            error_code add_native_source(native_source_type fd, translator_type func, destructor_type);
-            void remove_native_source(native_source_type fd);
+        epoll_fd = epoll_create1(0);
 
-            error_code send_event(event_details, raw_event);
+        epoll_event ev{};
+        ev.data.u64 = notify_data;
+        ev.events = EPOLLIN | EPOLLET;
 
-        private:
-            std::unordered_map<event_details::id_type, callback_type> event_mappings;
-            std::unordered_map<event_details::id_type, callback_type> group_mappings;
+        // figure out what to do with this
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, notify_fd, &ev) == -1) {}
+    }
 
-            // file descriptor to event translator
-            std::unordered_map<int, translator_type> event_translators;
-            std::unordered_map<int, destructor_type> event_destructors;
+    epoll_queue::~epoll_queue()
+    {
+        if (wait_timer_fd > 0)
+            ::close(wait_timer_fd);
+        if (epoll_fd > 0)
+            ::close(epoll_fd);
+    }
 
-            inline void call(raw_event& ev) {
-                if (event_mappings.contains(ev.type())) {
-                    event_mappings[ev.type()](ev);
-                }
-                if (group_mappings.contains(ev.group()) && ev.group() != 0) {
-                    group_mappings[ev.group()](ev);
-                }
-            }
+    /**
+     * Wait for ready descriptors
+     *
+     * \param   timeout how long to block, negative for no limit
+     *
+     * \return  what epoll_wait would
+     */
+    int epoll_queue::poll_events(epoll_event* events, int max_events, std::chrono::nanoseconds timeout) noexcept
+    {
+        if (timeout.count() < 0)
+            return epoll_wait(epoll_fd, events, max_events, -1);
 
-            int epoll_fd = -1;
-            int notify_fd = -1;
-    };
+#ifdef SYS_epoll_pwait2
+        if (has_pwait2)
+        {
+            __kernel_timespec ts{};
+            ts.tv_sec = timeout.count() / 1'000'000'000;
+            ts.tv_nsec = timeout.count() % 1'000'000'000;
 
-    // event_queue forwarders
-    void event_queue::bind_event_to_func(event_details::id_type evtype,callback_type evcallback) noexcept
-    { impl->bind_event_to_func(evtype, evcallback); }
+            int rval = static_cast<int>(::syscall(SYS_epoll_pwait2, epoll_fd, events, max_events, &ts, nullptr, 0));
+            if (rval != -1 || errno != ENOSYS)
+                return rval;
 
-    void event_queue::bind_group_to_func(event_details::id_type evtype,callback_type evcallback) noexcept
-    { impl->bind_event_to_func(evtype, evcallback, true); }
+            has_pwait2 = false;
+        }
+#endif
 
-    void event_queue::wait(std::chrono::milliseconds timeout) { impl->wait(timeout); }
-    void event_queue::poll() { impl->wait(0s, true); }
+        if (timeout % 1ms == 0ns || timeout > std::chrono::milliseconds(std::numeric_limits<int>::max()))
+        {
+            const auto ms = std::min<std::chrono::milliseconds::rep>(timeout / 1ms, std::numeric_limits<int>::max());
+            return epoll_wait(epoll_fd, events, max_events, static_cast<int>(ms));
+        }
 
-    error_code event_queue::add_native_source(native_source_type evdesc, translator_type func, destructor_type rfunc)
-    { return impl->add_native_source(evdesc, func, rfunc); }
+        if (wait_timer_fd == -1)
+        {
+            wait_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
 
-    void event_queue::send_event(event_details type, raw_event ev) { impl->send_event(type, std::move(ev)); }
+            epoll_event ev{};
+            ev.data.u64 = wait_timer_data;
+            ev.events = EPOLLIN;
 
+            if (wait_timer_fd == -1 || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wait_timer_fd, &ev) == -1)
+            {
+                std::cerr << "ERROR: could not set up a timerfd for waiting\n";
+                if (wait_timer_fd != -1)
+                    ::close(std::exchange(wait_timer_fd, -1));
+                return epoll_wait(epoll_fd, events, max_events, static_cast<int>(std::chrono::ceil<std::chrono::milliseconds>(timeout).count()));
+            }
+        }
 
-    // Actual implementation
-    event_queue::event_queue() noexcept : impl(std::make_unique<implementation>()) {}
-    event_queue::~event_queue() = default;
+        // a wakeup for an earlier wait may still be pending, the restart
+        // in wait() takes care of it
+        itimerspec spec{};
+        spec.it_value.tv_sec = timeout.count() / 1'000'000'000;
+        spec.it_value.tv_nsec = timeout.count() % 1'000'000'000;
 
-    event_queue::implementation::implementation()
-    {
-        epoll_fd = epoll_create1(0);
+        if (timerfd_settime(wait_timer_fd, 0, &spec, nullptr) == -1)
+            return epoll_wait(epoll_fd, events, max_events, 0);
 
-        // used for messages with no OS notification
-        notify_fd = eventfd(0, 0);
+        return epoll_wait(epoll_fd, events, max_events, -1);
+    }
 
+    /**
+     * Add a descriptor to the epoll set, tagged with its generation
+     */
+    bool epoll_queue::watch_source(native_source_type fd, const source_record& source) noexcept
+    {
         epoll_event ev{};
-        ev.data.fd = notify_fd;
-        ev.events = EPOLLIN | EPOLLET;
+        ev.events = EPOLLIN;
+        ev.data.u64 = source_data(fd, source.generation);
 
-        // figure out what to do with this
-        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, notify_fd, &ev) == -1) {}
+        if (source.mode == trigger_mode::edge)
+            ev.events |= EPOLLET;
+        else if (source.mode == trigger_mode::exclusive)
+            ev.events |= EPOLLEXCLUSIVE;
+
+        return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) == 0;
     }
 
-    event_queue::implementation::~implementation()
+    void epoll_queue::unwatch_source(native_source_type fd, const source_record&) noexcept
     {
-        if (epoll_fd > 0)
-            ::close(epoll_fd);
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr) == -1 && (errno == EBADF || errno == ENOENT))
+            may_have_orphans = true;
     }
 
     /**
-     * Set an action to be performed on an event
+     * Take the entry of a stale record out of the epoll set
      *
-     * \param   evtype  type ID for the event for which the action will be triggered
-     * \param   evcall  function to be called when the event happens
+     * Succeeding means the descriptor still refers to the file that was
+     * added, the source is live and is put back.  Otherwise the number was
+     * closed or went to another file, and the old entry is gone unless a
+     * duplicate of the descriptor keeps the file open.
      */
-    void event_queue::implementation::bind_event_to_func(event_details::id_type evtype,
-                                                         callback_type evcall,
-                                                         bool is_group) noexcept
+    bool epoll_queue::release_stale_source(native_source_type fd, const source_record& stale) noexcept
     {
-        if (is_group)
-        {
-            std::cout << "binding group " << evtype << " to callback\n";
-            group_mappings[evtype] = std::move(evcall);
-        }
-        else
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr) == 0)
         {
-            std::cout << "binding event " << evtype << " to callback\n";
-            event_mappings[evtype] = std::move(evcall);
+            watch_source(fd, stale);
+            errno = EEXIST;
+            return false;
         }
+
+        if (errno == EBADF || errno == ENOENT)
+            may_have_orphans = true;
+
+        return true;
+    }
+
+    /**
+     * Move the live sources and the internal descriptors to a new set
+     *
+     * A source is live if its descriptor still refers to the file in the
+     * old set, what else is in there was left behind by closed ones.
+     */
+    void epoll_queue::rebuild_set() noexcept
+    {
+        may_have_orphans = false;
+
+        const int fresh = epoll_create1(0);
+        if (fresh == -1)
+            return;
+
+        const int previous = std::exchange(epoll_fd, fresh);
+
+        epoll_event ev{};
+        ev.data.u64 = notify_data;
+        ev.events = EPOLLIN | EPOLLET;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, notify_fd, &ev) == -1) {}
+
+        if (timer_fd != -1)
+            watch_internal(timer_fd, timer_data);
+        if (wait_timer_fd != -1)
+            watch_internal(wait_timer_fd, wait_timer_data);
+
+        for_each_source([&](native_source_type fd, const source_record& source) {
+            if (epoll_ctl(previous, EPOLL_CTL_DEL, fd, nullptr) == 0)
+                watch_source(fd, source);
+        });
+
+        ::close(previous);
+    }
+
+    bool epoll_queue::watch_internal(int fd, uint64_t data) noexcept
+    {
+        epoll_event ev{};
+        ev.data.u64 = data;
+        ev.events = EPOLLIN;
+
+        return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) == 0;
     }
 
     /**
      * Wait until an event is triggered
      */
-    void event_queue::implementation::wait(std::chrono::milliseconds timeout, bool block) noexcept
+    void epoll_queue::wait(std::chrono::steady_clock::time_point deadline, bool block) noexcept
     {
-        constexpr static int max_events = 16;
-        auto timeout_offset = 0ms;
-        auto start = std::chrono::system_clock::now();
+        const running_scope running{*this};
+        events_sent = false;
+
+        // posted events count as received events, so only check
+        // what is already pending on the descriptors
+        if (dispatch_posted_events())
+            block = false;
 
         restart_function:
 
         int event_count = 0;
         int ignored_events = 0;
+        bool orphans_seen = false;
 
-        epoll_event native_event[max_events];
+        if (ready_events.size() < batch_size)
+            ready_events.resize(batch_size);
+
+        epoll_event* native_event = ready_events.data();
+        const int max_events = batch_size;
+
+        poll_calls.fetch_add(1, std::memory_order_relaxed);
 
         if (not block)
             event_count = epoll_wait(epoll_fd, native_event, max_events, 0);
-        else if (timeout.count() < 0)
-            event_count = epoll_wait(epoll_fd, native_event, max_events, -1);
         else
-            event_count = epoll_wait(epoll_fd, native_event, max_events, (timeout - timeout_offset).count());
+            event_count = poll_events(native_event, max_events, poll_timeout(deadline));
 
         for (int i = 0; i < event_count; ++i)
         {
-            if (native_event[i].data.fd == notify_fd)
+            const uint64_t data = native_event[i].data.u64;
+
+            if (data == notify_data)
+            {
+                if (dispatch_remote_events() == 0)
+                    ignored_events++;
                 continue;
-            if (event_translators.count(native_event[i].data.fd) == 0)
+            }
+            if (data == wait_timer_data)
+            {
+                uint64_t expirations;
+                if (::read(wait_timer_fd, &expirations, sizeof(expirations))) {}
+                ignored_events++;
                 continue;
-            if (event_translators[native_event[i].data.fd] == nullptr)
+            }
+            if (data == timer_data)
+            {
+                if (expire_timers() == 0)
+                    ignored_events++;
                 continue;
+            }
 
-            raw_event ev = event_translators[native_event[i].data.fd](native_event[i].data.fd);
-
-            // empty events are special, since if we only get those,
-            // we do not break from blocking
-            if (get_event_details_for<empty_event>().event_id == ev.type())
+            // removed earlier in the batch, or left behind in the set
+            if (not is_registered(source_fd(data), source_generation(data)))
             {
+                orphans_seen = orphans_seen || may_have_orphans;
                 ignored_events++;
                 continue;
             }
 
-            call(ev);
+            if (not dispatch_source(data))
+                ignored_events++;
         }
 
-        if (ignored_events == event_count) {
-            timeout_offset = std::chrono::duration_cast<std::chrono::milliseconds>(
-                    std::chrono::system_clock::now() - start);
-            goto restart_function;
-        }
-    }
+        if (orphans_seen)
+            rebuild_set();
 
-    /**
-     * Handle sent event directly
-     */
-    error_code event_queue::implementation::send_event(event_details type, raw_event ev)
-    {
-        (void)type;
-        call(ev);
-        eventfd_write(notify_fd, 1);
+        adapt_batch_size(event_count);
 
-        return error_code::success;
-    }
+        const int resumed = resume_expired_deadlines();
 
-    /**
-     * Add a file description to the epoll queue
-     */
-    error_code event_queue::implementation::add_native_source(native_source_type fd,
-                                                              translator_type func,
-                                                              destructor_type rfunc)
-    {
-        epoll_event ev{};
-
-        ev.events = EPOLLIN;
-        ev.data.fd = fd;
-
-        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev))
-            return error_code::system_error;
-
-        event_translators[fd] = func;
-        event_destructors[fd] = rfunc;
-
-        return error_code::success;
-    }
-
-    /**
-     *
-     */
-    void event_queue::implementation::remove_native_source(native_source_type fd)
-    {
-        event_translators.erase(fd);
+        // nothing but ignored events, or a deadline that woke us up early
+        if (block && event_count >= 0 && ignored_events == event_count && resumed == 0 && not events_sent) {
+            if (std::chrono::steady_clock::now() < deadline)
+                goto restart_function;
+        }
     }
 }
 /*
@@ -0,0 +1,657 @@
+/*
+ *  \brief      Event queue implementation for linux/io_uring
+ *  \author     Jari Ronkainen
+ *  \version    0.1
+ *
+ *  Implementations for the event handling functions for
+ *  linux/io_uring.  Talks to the kernel through the raw system calls,
+ *  no liburing needed.
+ *
+ */
+#include "queue_implementation.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <atomic>
+#include <cstring>
+#include <vector>
+
+#include <linux/io_uring.h>
+#include <linux/time_types.h>
+
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <iostream>
+
+using namespace std::chrono_literals;
+
+namespace cppevents
+{
+    namespace
+    {
+        class io_uring_queue final : public event_queue::implementation
+        {
+            public:
+                io_uring_queue();
+                ~io_uring_queue();
+
+                void wait(std::chrono::steady_clock::time_point deadline, bool block = true) noexcept override;
+
+            private:
+                // level triggered sources are polled one shot at a time and
+                // re-armed after translation, edge triggered ones stay armed
+                // with a multishot poll.  exclusive ones are woken alone
+                // among the queues polling the same descriptor, which only
+                // works for one shot polls
+                bool watch_source(native_source_type fd, const source_record& source) noexcept override;
+                void unwatch_source(native_source_type fd, const source_record& source) noexcept override;
+                bool release_stale_source(native_source_type fd, const source_record& stale) noexcept override;
+                bool watch_internal(int fd, uint64_t data) noexcept override;
+
+                // epoll set that is never waited on, holding every watched
+                // descriptor with no events.  epoll knows a descriptor
+                // together with its open file, so it tells whether the
+                // number of a stale record still refers to the file that
+                // was polled, which device and inode cannot for the files
+                // sharing an anonymous inode
+                int identity_fd = -1;
+
+                // the rings shared with the kernel.  submissions are only made
+                // visible and handed over when there is nothing left to reap,
+                // so under load waiting takes no system calls at all
+                struct submission_ring
+                {
+                    unsigned* head = nullptr;
+                    unsigned* tail = nullptr;
+                    unsigned* array = nullptr;
+                    unsigned mask = 0;
+                    unsigned entries = 0;
+                    io_uring_sqe* sqes = nullptr;
+
+                    // tail of the entries filled in but not yet submitted
+                    unsigned local_tail = 0;
+                    unsigned submitted_tail = 0;
+                };
+
+                struct completion_ring
+                {
+                    unsigned* head = nullptr;
+                    unsigned* tail = nullptr;
+                    unsigned mask = 0;
+                    io_uring_cqe* cqes = nullptr;
+                };
+
+                static constexpr unsigned submission_entries = 1024;
+                static constexpr unsigned completion_entries = 8192;
+
+                // user_data of requests whose completion nobody cares about
+                static constexpr uint64_t ignored_data = 0;
+
+                bool setup_ring(unsigned flags) noexcept;
+                io_uring_sqe* next_sqe() noexcept;
+                io_uring_sqe* reserve_sqe() noexcept;
+                bool arm_poll(native_source_type fd, uint64_t data, bool multishot, bool exclusive = false) noexcept;
+
+                // polls that found no room in the ring even after handing
+                // it over, e.g. while the kernel holds back submissions
+                // for an overflowing completion ring.  armed before the
+                // next submit, unless their source went away meanwhile
+                struct pending_poll
+                {
+                    native_source_type fd;
+                    uint64_t data;
+                    bool multishot;
+                    bool exclusive;
+                };
+
+                void arm_pending_polls() noexcept;
+                std::vector<pending_poll> pending_polls;
+                int enter(unsigned min_complete, std::chrono::nanoseconds timeout) noexcept;
+                int reap(int offset, int max_events) noexcept;
+
+                // completions taken off the ring to make room for a
+                // submission, handled on the next wakeup
+                int take_backlog(int max_events) noexcept;
+                std::vector<io_uring_cqe> backlog;
+
+                std::vector<io_uring_cqe> ready_events;
+
+                int ring_fd = -1;
+
+                submission_ring sq;
+                completion_ring cq;
+
+                void* sq_mapping = nullptr;
+                std::size_t sq_mapping_size = 0;
+                void* cq_mapping = nullptr;
+                std::size_t cq_mapping_size = 0;
+                void* sqe_mapping = nullptr;
+                std::size_t sqe_mapping_size = 0;
+        };
+    }
+
+    event_queue::event_queue() noexcept : impl(std::make_unique<io_uring_queue>()) {}
+
+    io_uring_queue::io_uring_queue()
+    {
+        ready_events.resize(batch_size);
+
+        identity_fd = epoll_create1(EPOLL_CLOEXEC);
+
+        // cooperative task running is only a hint, older kernels
+        // do without
+        if (not setup_ring(IORING_SETUP_CQSIZE | IORING_SETUP_COOP_TASKRUN) && not setup_ring(IORING_SETUP_CQSIZE))
+            std::cerr << "ERROR: could not set up io_uring: " << std::strerror(errno) << "\n";
+
+        // figure out what to do with this
+        if (not arm_poll(notify_fd, notify_data, true)) {}
+    }
+
+    io_uring_queue::~io_uring_queue()
+    {
+        // closing the ring cancels every poll still armed
+        if (ring_fd > 0)
+            ::close(ring_fd);
+        if (identity_fd > 0)
+            ::close(identity_fd);
+
+        if (sqe_mapping != nullptr)
+            ::munmap(sqe_mapping, sqe_mapping_size);
+        if (cq_mapping != nullptr && cq_mapping != sq_mapping)
+            ::munmap(cq_mapping, cq_mapping_size);
+        if (sq_mapping != nullptr)
+            ::munmap(sq_mapping, sq_mapping_size);
+    }
+
+    /**
+     * Create the ring and map it to our address space
+     *
+     * \return false if the kernel refused, errno tells why
+     */
+    bool io_uring_queue::setup_ring(unsigned flags) noexcept
+    {
+        io_uring_params params{};
+        params.flags = flags;
+        params.cq_entries = completion_entries;
+
+        ring_fd = static_cast<int>(::syscall(__NR_io_uring_setup, submission_entries, &params));
+        if (ring_fd < 0)
+            return false;
+
+        sq_mapping_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_mapping_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+        if (params.features & IORING_FEAT_SINGLE_MMAP)
+            sq_mapping_size = cq_mapping_size = std::max(sq_mapping_size, cq_mapping_size);
+
+        sq_mapping = ::mmap(nullptr, sq_mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+        if (sq_mapping == MAP_FAILED)
+            sq_mapping = nullptr;
+
+        if (params.features & IORING_FEAT_SINGLE_MMAP)
+            cq_mapping = sq_mapping;
+        else
+            cq_mapping = ::mmap(nullptr, cq_mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+        if (cq_mapping == MAP_FAILED)
+            cq_mapping = nullptr;
+
+        sqe_mapping_size = params.sq_entries * sizeof(io_uring_sqe);
+        sqe_mapping = ::mmap(nullptr, sqe_mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+        if (sqe_mapping == MAP_FAILED)
+            sqe_mapping = nullptr;
+
+        if (sq_mapping == nullptr || cq_mapping == nullptr || sqe_mapping == nullptr)
+        {
+            int saved = errno;
+            if (sqe_mapping != nullptr)
+                ::munmap(std::exchange(sqe_mapping, nullptr), sqe_mapping_size);
+            if (cq_mapping != nullptr && cq_mapping != sq_mapping)
+                ::munmap(cq_mapping, cq_mapping_size);
+            cq_mapping = nullptr;
+            if (sq_mapping != nullptr)
+                ::munmap(std::exchange(sq_mapping, nullptr), sq_mapping_size);
+            ::close(std::exchange(ring_fd, -1));
+            errno = saved;
+            return false;
+        }
+
+        auto* sq_base = static_cast<std::byte*>(sq_mapping);
+        sq.head = reinterpret_cast<unsigned*>(sq_base + params.sq_off.head);
+        sq.tail = reinterpret_cast<unsigned*>(sq_base + params.sq_off.tail);
+        sq.array = reinterpret_cast<unsigned*>(sq_base + params.sq_off.array);
+        sq.mask = *reinterpret_cast<unsigned*>(sq_base + params.sq_off.ring_mask);
+        sq.entries = *reinterpret_cast<unsigned*>(sq_base + params.sq_off.ring_entries);
+        sq.sqes = static_cast<io_uring_sqe*>(sqe_mapping);
+        sq.local_tail = sq.submitted_tail = *sq.tail;
+
+        auto* cq_base = static_cast<std::byte*>(cq_mapping);
+        cq.head = reinterpret_cast<unsigned*>(cq_base + params.cq_off.head);
+        cq.tail = reinterpret_cast<unsigned*>(cq_base + params.cq_off.tail);
+        cq.mask = *reinterpret_cast<unsigned*>(cq_base + params.cq_off.ring_mask);
+        cq.cqes = reinterpret_cast<io_uring_cqe*>(cq_base + params.cq_off.cqes);
+
+        return true;
+    }
+
+    /**
+     * Get the next free submission queue entry
+     *
+     * Submits what is pending first if the ring is full.
+     *
+     * \return cleared entry, or nullptr if there is no ring or no room
+     */
+    io_uring_sqe* io_uring_queue::next_sqe() noexcept
+    {
+        if (ring_fd < 0)
+            return nullptr;
+
+        unsigned head = std::atomic_ref<unsigned>(*sq.head).load(std::memory_order_acquire);
+        if (sq.local_tail - head >= sq.entries)
+        {
+            enter(0, 0ns);
+            head = std::atomic_ref<unsigned>(*sq.head).load(std::memory_order_acquire);
+            if (sq.local_tail - head >= sq.entries)
+                return nullptr;
+        }
+
+        const unsigned index = sq.local_tail & sq.mask;
+        io_uring_sqe* sqe = &sq.sqes[index];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sq.array[index] = index;
+        sq.local_tail++;
+
+        return sqe;
+    }
+
+    static void prepare_poll(io_uring_sqe* sqe, int fd, uint64_t data, bool multishot, bool exclusive) noexcept
+    {
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = fd;
+        sqe->poll32_events = exclusive ? POLLIN | EPOLLEXCLUSIVE : POLLIN;
+        sqe->user_data = data;
+        if (multishot)
+            sqe->len = IORING_POLL_ADD_MULTI;
+    }
+
+    /**
+     * Queue a poll for readability of a descriptor
+     *
+     * Without room in the ring the poll waits in pending_polls.
+     *
+     * \return false if there is no ring
+     */
+    bool io_uring_queue::arm_poll(native_source_type fd, uint64_t data, bool multishot, bool exclusive) noexcept
+    {
+        if (ring_fd < 0)
+            return false;
+
+        io_uring_sqe* sqe = pending_polls.empty() ? reserve_sqe() : nullptr;
+        if (sqe == nullptr)
+        {
+            pending_polls.push_back(pending_poll{fd, data, multishot, exclusive});
+            return true;
+        }
+
+        prepare_poll(sqe, fd, data, multishot, exclusive);
+        return true;
+    }
+
+    void io_uring_queue::arm_pending_polls() noexcept
+    {
+        std::size_t done = 0;
+        for (; done < pending_polls.size(); ++done)
+        {
+            const pending_poll& poll = pending_polls[done];
+
+            const bool internal = poll.data == notify_data || poll.data == timer_data;
+            if (not internal && not is_registered(poll.fd, source_generation(poll.data)))
+                continue;
+
+            io_uring_sqe* sqe = reserve_sqe();
+            if (sqe == nullptr)
+                break;
+
+            prepare_poll(sqe, poll.fd, poll.data, poll.multishot, poll.exclusive);
+        }
+
+        pending_polls.erase(pending_polls.begin(), pending_polls.begin() + done);
+    }
+
+    /**
+     * Hand pending submissions to the kernel, and wait for completions
+     *
+     * \param   min_complete    completions to wait for, 0 to only submit
+     * \param   timeout         how long to wait, negative for forever
+     *
+     * \return  result of io_uring_enter
+     */
+    int io_uring_queue::enter(unsigned min_complete, std::chrono::nanoseconds timeout) noexcept
+    {
+        if (ring_fd < 0)
+            return -1;
+
+        std::atomic_ref<unsigned>(*sq.tail).store(sq.local_tail, std::memory_order_release);
+
+        const unsigned to_submit = sq.local_tail - sq.submitted_tail;
+        unsigned flags = min_complete > 0 ? IORING_ENTER_GETEVENTS : 0;
+
+        __kernel_timespec ts{};
+        io_uring_getevents_arg arg{};
+        void* argp = nullptr;
+        std::size_t argsz = 0;
+
+        if (min_complete > 0 && timeout.count() >= 0)
+        {
+            ts.tv_sec = timeout.count() / 1'000'000'000;
+            ts.tv_nsec = timeout.count() % 1'000'000'000;
+
+            arg.sigmask_sz = _NSIG / 8;
+            arg.ts = reinterpret_cast<uint64_t>(&ts);
+
+            flags |= IORING_ENTER_EXT_ARG;
+            argp = &arg;
+            argsz = sizeof(arg);
+        }
+
+        poll_calls.fetch_add(1, std::memory_order_relaxed);
+
+        int rval = static_cast<int>(::syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, argp, argsz));
+
+        // whatever the kernel consumed is gone, even on errors
+        sq.submitted_tail = std::atomic_ref<unsigned>(*sq.head).load(std::memory_order_acquire);
+        if (sq.local_tail - sq.submitted_tail > sq.entries)
+            sq.submitted_tail = sq.local_tail;
+
+        return rval;
+    }
+
+    /**
+     * Get a submission queue entry even if the ring stays full
+     *
+     * The kernel takes no submissions while its completions have nowhere
+     * to go, so those are moved to the backlog until there is room.
+     *
+     * \return cleared entry, or nullptr if there is no ring
+     */
+    io_uring_sqe* io_uring_queue::reserve_sqe() noexcept
+    {
+        io_uring_sqe* sqe = next_sqe();
+
+        for (int attempt = 0; sqe == nullptr && ring_fd >= 0 && attempt < 8; ++attempt)
+        {
+            unsigned head = *cq.head;
+            const unsigned tail = std::atomic_ref<unsigned>(*cq.tail).load(std::memory_order_acquire);
+
+            for (; head != tail; ++head)
+                backlog.push_back(cq.cqes[head & cq.mask]);
+
+            std::atomic_ref<unsigned>(*cq.head).store(head, std::memory_order_release);
+
+            sqe = next_sqe();
+        }
+
+        return sqe;
+    }
+
+    /**
+     * Move completions of the backlog to the ready list
+     *
+     * \return number of completions taken
+     */
+    int io_uring_queue::take_backlog(int max_events) noexcept
+    {
+        if (backlog.empty())
+            return 0;
+
+        const int count = std::min<int>(backlog.size(), max_events);
+        std::copy_n(backlog.begin(), count, ready_events.begin());
+        backlog.erase(backlog.begin(), backlog.begin() + count);
+
+        return count;
+    }
+
+    /**
+     * Copy available completions to the ready list
+     *
+     * \return number of completions taken
+     */
+    int io_uring_queue::reap(int offset, int max_events) noexcept
+    {
+        if (ring_fd < 0)
+            return 0;
+
+        unsigned head = *cq.head;
+        const unsigned tail = std::atomic_ref<unsigned>(*cq.tail).load(std::memory_order_acquire);
+
+        int count = 0;
+        while (head != tail && offset + count < max_events)
+        {
+            ready_events[offset + count] = cq.cqes[head & cq.mask];
+            head++;
+            count++;
+        }
+
+        std::atomic_ref<unsigned>(*cq.head).store(head, std::memory_order_release);
+
+        return count;
+    }
+
+    bool io_uring_queue::watch_source(native_source_type fd, const source_record& source) noexcept
+    {
+        // a poll request only fails once it reaches the kernel, the
+        // identity set refuses right away what the epoll backend would
+        epoll_event ev{};
+        if (epoll_ctl(identity_fd, EPOLL_CTL_ADD, fd, &ev) == -1)
+            return false;
+
+        if (arm_poll(fd, source_data(fd, source.generation),
+                     source.mode == trigger_mode::edge,
+                     source.mode == trigger_mode::exclusive))
+            return true;
+
+        epoll_ctl(identity_fd, EPOLL_CTL_DEL, fd, nullptr);
+        return false;
+    }
+
+    /**
+     * Cancel the poll of a source
+     *
+     * Submitted right away, the poll holds a reference to the file
+     * that would keep it open after the caller closes the descriptor.
+     */
+    void io_uring_queue::unwatch_source(native_source_type fd, const source_record& source) noexcept
+    {
+        epoll_ctl(identity_fd, EPOLL_CTL_DEL, fd, nullptr);
+
+        io_uring_sqe* sqe = reserve_sqe();
+        if (sqe == nullptr)
+        {
+            std::cerr << "ERROR: could not cancel the poll of descriptor " << fd << "\n";
+            return;
+        }
+
+        sqe->opcode = IORING_OP_POLL_REMOVE;
+        sqe->fd = -1;
+        sqe->addr = source_data(fd, source.generation);
+        sqe->user_data = ignored_data;
+
+        enter(0, 0ns);
+    }
+
+    /**
+     * Cancel the poll of a stale record, unless the descriptor still
+     * refers to the open file that was polled
+     */
+    bool io_uring_queue::release_stale_source(native_source_type fd, const source_record& stale) noexcept
+    {
+        if (epoll_ctl(identity_fd, EPOLL_CTL_DEL, fd, nullptr) == 0)
+        {
+            // still in use, put it back the way it was
+            epoll_event ev{};
+            epoll_ctl(identity_fd, EPOLL_CTL_ADD, fd, &ev);
+
+            errno = EEXIST;
+            return false;
+        }
+
+        // closed, or the number went to another file.  the poll is
+        // cancelled by its tag, whatever the descriptor is now
+        unwatch_source(fd, stale);
+        return true;
+    }
+
+    bool io_uring_queue::watch_internal(int fd, uint64_t data) noexcept
+    {
+        return arm_poll(fd, data, true);
+    }
+
+    /**
+     * Wait until an event is triggered
+     */
+    void io_uring_queue::wait(std::chrono::steady_clock::time_point deadline, bool block) noexcept
+    {
+        const running_scope running{*this};
+        events_sent = false;
+
+        // posted events count as received events, so only check
+        // what is already pending on the descriptors
+        if (dispatch_posted_events())
+            block = false;
+
+        restart_function:
+
+        int ignored_events = 0;
+        bool interrupted = false;
+
+        if (ready_events.size() < batch_size)
+            ready_events.resize(batch_size);
+
+        const int max_events = batch_size;
+
+        // completions already in the ring need no system call, pending
+        // submissions are handed over once the ring has been drained
+        if (not pending_polls.empty())
+            arm_pending_polls();
+
+        int event_count = take_backlog(max_events);
+        event_count += reap(event_count, max_events);
+
+        if (event_count < max_events && (sq.local_tail != sq.submitted_tail || event_count == 0))
+        {
+            const std::chrono::nanoseconds wait_time = poll_timeout(deadline);
+
+            if (event_count > 0 || not block || wait_time.count() == 0)
+                enter(0, 0ns);
+            else if (enter(1, wait_time) < 0 && errno == EINTR)
+                interrupted = true;
+
+            event_count += reap(event_count, max_events);
+        }
+
+        for (int i = 0; i < event_count; ++i)
+        {
+            const io_uring_cqe cqe = ready_events[i];
+
+            if (cqe.user_data == ignored_data)
+            {
+                ignored_events++;
+                continue;
+            }
+
+            if (cqe.user_data == notify_data)
+            {
+                // the kernel may drop a multishot poll, e.g. on overflow
+                if (not (cqe.flags & IORING_CQE_F_MORE))
+                    arm_poll(notify_fd, notify_data, true);
+
+                if (dispatch_remote_events() == 0)
+                    ignored_events++;
+                continue;
+            }
+
+            if (cqe.user_data == timer_data)
+            {
+                if (not (cqe.flags & IORING_CQE_F_MORE))
+                    arm_poll(timer_fd, timer_data, true);
+
+                if (expire_timers() == 0)
+                    ignored_events++;
+                continue;
+            }
+
+            const native_source_type fd = source_fd(cqe.user_data);
+            const uint32_t generation = source_generation(cqe.user_data);
+
+            // removed, and maybe replaced, by a handler earlier in the batch
+            const source_record* source = find_source(fd);
+            if (source == nullptr || source->generation != generation)
+            {
+                ignored_events++;
+                continue;
+            }
+
+            const bool multishot = source->mode == trigger_mode::edge;
+            const bool exclusive = source->mode == trigger_mode::exclusive;
+
+            // the poll failed instead of reporting readiness.  the source
+            // is still registered, so it is polled again unless its
+            // descriptor is gone, which would only fail again right away
+            if (cqe.res < 0)
+            {
+                ignored_events++;
+                if (cqe.res != -EBADF && not (cqe.flags & IORING_CQE_F_MORE))
+                    arm_poll(fd, cqe.user_data, multishot, exclusive);
+                continue;
+            }
+
+            if (not dispatch_source(cqe.user_data))
+                ignored_events++;
+
+            // re-arm one shot polls, and multishot ones the kernel gave
+            // up on, unless the source went away meanwhile
+            if (multishot && (cqe.flags & IORING_CQE_F_MORE))
+                continue;
+
+            if (is_registered(fd, generation))
+                arm_poll(fd, cqe.user_data, multishot, exclusive);
+        }
+
+        adapt_batch_size(event_count);
+
+        const int resumed = resume_expired_deadlines();
+
+        // nothing but ignored events, or a deadline that woke us up early
+        if (block && not interrupted && ignored_events == event_count && resumed == 0 && not events_sent) {
+            if (std::chrono::steady_clock::now() < deadline)
+                goto restart_function;
+        }
+    }
+}
+/*
+    Copyright (c) 2021 Jari Ronkainen
+
+    This software is provided 'as-is', without any express or implied warranty.
+    In no event will the authors be held liable for any damages arising from the
+    use of this software.
+
+    Permission is granted to anyone to use this software for any purpose, including
+    commercial applications, and to alter it and redistribute it freely, subject to
+    the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not claim
+       that you wrote the original software. If you use this software in a product,
+       an acknowledgment in the product documentation would be appreciated but is
+       not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+       misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source distribution.
+*/
@@ -0,0 +1,843 @@
+/*
+ *  \brief      Event queue implementation shared by the linux backends
+ *  \author     Jari Ronkainen
+ *  \version    0.8
+ *
+ *  Everything of the event queue that does not depend on the polling
+ *  system, the backends only watch descriptors and wait for them
+ *
+ */
+#include <cppevents/timer.hpp>
+
+#include "queue_implementation.hpp"
+
+#include <algorithm>
+#include <cerrno>
+
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+#include <unistd.h>
+
+using namespace std::chrono_literals;
+
+namespace cppevents
+{
+    // event_queue forwarders, the constructor is in the backend
+    event_queue::~event_queue() { impl->destroy_waiters(); }
+
+    error_code event_queue::bind_event_to_func(event_details::id_type evtype, callback_type evcallback, std::string_view name) noexcept
+    { return impl->bind_event_to_func(evtype, std::move(evcallback), name); }
+
+    error_code event_queue::bind_group_to_func(event_details::id_type evtype, callback_type evcallback, std::string_view name) noexcept
+    { return impl->bind_event_to_func(evtype, std::move(evcallback), name, true); }
+
+    void event_queue::wait(std::chrono::steady_clock::time_point deadline) { impl->wait(deadline); }
+    void event_queue::poll() { impl->wait(std::chrono::steady_clock::now(), true); }
+
+    error_code event_queue::add_native_source(native_source_type evdesc, translator_type func, destructor_type rfunc, trigger_mode mode)
+    { return impl->add_native_source(evdesc, func, rfunc, mode); }
+
+    error_code event_queue::add_native_source(native_source_type evdesc, batch_translator_type func, destructor_type rfunc, trigger_mode mode)
+    { return impl->add_native_source(evdesc, func, rfunc, mode); }
+
+    void event_queue::send_event(event_details type, raw_event ev) { impl->send_event(type, std::move(ev)); }
+    void event_queue::post_event(event_details type, raw_event ev) { impl->post_event(type, std::move(ev)); }
+
+    void event_queue::execute(task_type task) { impl->execute(std::move(task)); }
+
+    queue_statistics event_queue::statistics() const noexcept { return impl->statistics(); }
+
+    void event_queue::set_batch_size(uint32_t size, uint32_t max_size) noexcept { impl->set_batch_size(size, max_size); }
+
+    void event_queue::set_memory_resource(std::pmr::memory_resource* resource) noexcept { impl->set_memory_resource(resource); }
+
+    void event_queue::remove_native_source(native_source_type fd) { impl->remove_native_source(fd); }
+
+    void event_queue::await_event(event_details::id_type type, detail::event_waiter& waiter) { impl->await_event(type, waiter); }
+    void event_queue::await_deadline(detail::deadline_waiter& waiter) { impl->await_deadline(waiter); }
+
+    bool event_queue::await_readable(native_source_type fd, detail::readiness_waiter& waiter, error_code& result)
+    { return impl->await_readable(fd, waiter, result); }
+
+    error_code event_queue::add_timer(const timer& conf) { return impl->add_timer(conf); }
+    bool event_queue::cancel_timer(int timer_id) { return impl->cancel_timer(timer_id); }
+
+    error_code event_queue::add_signal(int signal) { return impl->add_signal(signal); }
+    bool event_queue::remove_signal(int signal) { return impl->remove_signal(signal); }
+
+
+    // Actual implementation
+    event_queue::implementation::implementation()
+    {
+        // used for messages with no OS notification, the backend
+        // starts watching it
+        notify_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    }
+
+    event_queue::implementation::~implementation()
+    {
+        inbox_node* node = inbox.exchange(nullptr, std::memory_order_acquire);
+        while (node != nullptr)
+            delete std::exchange(node, node->next);
+
+        if (timer_fd > 0)
+            ::close(timer_fd);
+        if (notify_fd > 0)
+            ::close(notify_fd);
+
+        pool.abandon();
+    }
+
+    /**
+     * Make the queue the one run by the calling thread until the scope ends
+     *
+     * Large events, receive buffers and coroutine frames created on this
+     * thread meanwhile are allocated from the pool of the queue.
+     */
+    event_queue::implementation::running_scope::running_scope(implementation& queue) noexcept
+        : previous_pool{detail::current_event_pool()}
+    {
+        queue.queue_thread.store(std::this_thread::get_id(), std::memory_order_relaxed);
+        queue.pool.set_owner(std::this_thread::get_id());
+        detail::current_event_pool() = &queue.pool;
+    }
+
+    event_queue::implementation::running_scope::~running_scope()
+    {
+        detail::current_event_pool() = previous_pool;
+    }
+
+    /**
+     * Set the memory resource the event pool gets its slabs from
+     */
+    void event_queue::implementation::set_memory_resource(std::pmr::memory_resource* resource) noexcept
+    {
+        pool.set_upstream(resource != nullptr ? resource : std::pmr::new_delete_resource());
+    }
+
+    /**
+     * Set an action to be performed on an event
+     *
+     * \param   evtype  type ID for the event for which the action will be triggered
+     * \param   evcall  function to be called when the event happens
+     * \param   name    name of the type, used to detect id collisions
+     *
+     * \return  error_code::already_exists if a type with another name has
+     *          been bound with the same id
+     */
+    error_code event_queue::implementation::bind_event_to_func(event_details::id_type evtype,
+                                                               callback_type evcall,
+                                                               std::string_view name,
+                                                               bool is_group) noexcept
+    {
+        auto& mappings = is_group ? group_mappings : event_mappings;
+        return mappings.insert(evtype, name, std::move(evcall));
+    }
+
+    error_code event_queue::implementation::handler_table::insert(event_details::id_type id,
+                                                                  std::string_view name,
+                                                                  callback_type callback)
+    {
+        // keep at most half of the slots in use
+        if ((callbacks.size() + 1) * 2 > slots.size())
+        {
+            std::vector<slot> old_slots(std::max<std::size_t>(slots.size() * 2, 16));
+            std::swap(slots, old_slots);
+
+            for (const slot& entry : old_slots)
+                if (entry.id != 0)
+                    find_slot(entry.id) = entry;
+        }
+
+        slot& entry = find_slot(id);
+
+        if (entry.id == id)
+        {
+            if (not name.empty() && not entry.name.empty() && name != entry.name)
+                return error_code::already_exists;
+        }
+        else
+        {
+            entry.id = id;
+            entry.callback = &callbacks.emplace_back();
+        }
+
+        if (not name.empty())
+            entry.name = name;
+        *entry.callback = std::move(callback);
+
+        return error_code::success;
+    }
+
+    /**
+     * Slot of an id, or the empty one it would go to
+     */
+    event_queue::implementation::handler_table::slot& event_queue::implementation::handler_table::find_slot(event_details::id_type id) noexcept
+    {
+        const std::size_t mask = slots.size() - 1;
+        std::size_t i = id & mask;
+
+        while (slots[i].id != 0 && slots[i].id != id)
+            i = (i + 1) & mask;
+
+        return slots[i];
+    }
+
+    /**
+     * Dispatch events posted before this call
+     *
+     * \return true if anything was dispatched
+     */
+    bool event_queue::implementation::dispatch_posted_events()
+    {
+        if (posted_events.empty())
+            return false;
+
+        std::swap(posted_events, dispatched_events);
+
+        for (raw_event& ev : dispatched_events)
+            call(ev);
+
+        dispatched_events.clear();
+
+        return true;
+    }
+
+    /**
+     * Set how many ready descriptors a single wakeup can handle
+     *
+     * \param   size        batch size, or the minimum when adaptive
+     * \param   max_size    upper limit for adaptive sizing, 0 for fixed size
+     */
+    void event_queue::implementation::set_batch_size(uint32_t size, uint32_t max_size) noexcept
+    {
+        min_batch_size = std::max(size, 1u);
+        max_batch_size = std::max(max_size, min_batch_size);
+        batch_size = min_batch_size;
+    }
+
+    void event_queue::implementation::adapt_batch_size(int event_count) noexcept
+    {
+        if (event_count == static_cast<int>(batch_size))
+        {
+            full_batches.fetch_add(1, std::memory_order_relaxed);
+
+            if (batch_size < max_batch_size)
+                batch_size = std::min(batch_size * 2, max_batch_size);
+        }
+        else if (event_count <= static_cast<int>(batch_size / 4) && batch_size > min_batch_size)
+        {
+            batch_size = std::max(batch_size / 2, min_batch_size);
+        }
+    }
+
+    /**
+     * Suspend a coroutine until the next event of a type
+     */
+    void event_queue::implementation::await_event(event_details::id_type type, detail::event_waiter& waiter)
+    {
+        detail::event_waiter*& list = event_waiters[type];
+        waiter.next = list;
+        list = &waiter;
+        waiting_coroutines++;
+    }
+
+    /**
+     * Resume everyone waiting for the type of an event, in the
+     * order they started waiting
+     */
+    void event_queue::implementation::resume_event_waiters(raw_event& ev)
+    {
+        auto it = event_waiters.find(ev.type());
+        if (it == event_waiters.end() || it->second == nullptr)
+            return;
+
+        // taken as a whole, those that wait again wait for the next one
+        detail::event_waiter* node = std::exchange(it->second, nullptr);
+
+        detail::event_waiter* reversed = nullptr;
+        while (node != nullptr)
+            reversed = std::exchange(node, std::exchange(node->next, reversed));
+
+        while (reversed != nullptr)
+        {
+            detail::event_waiter* waiter = std::exchange(reversed, reversed->next);
+            waiting_coroutines--;
+            waiter->event = &ev;
+            waiter->handle.resume();
+        }
+    }
+
+    /**
+     * Suspend a coroutine until a point in time
+     */
+    void event_queue::implementation::await_deadline(detail::deadline_waiter& waiter)
+    {
+        deadlines.push_back(&waiter);
+        std::push_heap(deadlines.begin(), deadlines.end(), [](auto* a, auto* b) { return a->deadline > b->deadline; });
+    }
+
+    /**
+     * Resume coroutines whose deadline has passed
+     *
+     * \return number of coroutines resumed
+     */
+    int event_queue::implementation::resume_expired_deadlines()
+    {
+        if (deadlines.empty())
+            return 0;
+
+        const auto now = std::chrono::steady_clock::now();
+
+        int count = 0;
+        while (not deadlines.empty() && deadlines.front()->deadline <= now)
+        {
+            std::pop_heap(deadlines.begin(), deadlines.end(), [](auto* a, auto* b) { return a->deadline > b->deadline; });
+            detail::deadline_waiter* waiter = deadlines.back();
+            deadlines.pop_back();
+
+            waiter->handle.resume();
+            count++;
+        }
+
+        return count;
+    }
+
+    std::chrono::nanoseconds event_queue::implementation::poll_timeout(std::chrono::steady_clock::time_point deadline) const noexcept
+    {
+        if (not deadlines.empty())
+            deadline = std::min(deadline, deadlines.front()->deadline);
+
+        if (deadline == std::chrono::steady_clock::time_point::max())
+            return -1ns;
+
+        // compared first, the distance to a deadline far in the past
+        // does not fit the clock
+        const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (deadline <= now)
+            return 0ns;
+
+        return deadline - now;
+    }
+
+    /**
+     * Resume the coroutine waiting on a readable descriptor, or
+     * remember the edge for the next one
+     *
+     * \return number of coroutines resumed
+     */
+    int event_queue::implementation::resume_readiness_waiter(readiness_watch& watch)
+    {
+        if (watch.waiter == nullptr)
+        {
+            watch.ready = true;
+            return 0;
+        }
+
+        std::exchange(watch.waiter, nullptr)->handle.resume();
+        return 1;
+    }
+
+    void event_queue::implementation::destroy_waiters() noexcept
+    {
+        for (auto& [type, list] : event_waiters)
+            while (list != nullptr)
+                std::exchange(list, list->next)->handle.destroy();
+
+        for (source_record& source : sources)
+            if (source.watch.waiter != nullptr)
+                std::exchange(source.watch.waiter, nullptr)->handle.destroy();
+
+        for (detail::deadline_waiter* waiter : deadlines)
+            waiter->handle.destroy();
+
+        event_waiters.clear();
+        deadlines.clear();
+        waiting_coroutines = 0;
+    }
+
+    /**
+     * Start a timer, or restart the one with the same id
+     *
+     * The first timer creates the timerfd of the queue, the rest
+     * only link themselves into the wheel.
+     */
+    error_code event_queue::implementation::add_timer(const timer& conf)
+    {
+        if (timer_fd == -1)
+        {
+            timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+            if (timer_fd == -1)
+                return error_code::system_error;
+
+            if (not watch_internal(timer_fd, timer_data))
+            {
+                ::close(std::exchange(timer_fd, -1));
+                return error_code::system_error;
+            }
+        }
+
+        timers.schedule(conf.id, conf.interval(), conf.interval(), conf.repeats, conf.slack);
+        arm_timer_fd();
+
+        return error_code::success;
+    }
+
+    /**
+     * Stop a timer
+     *
+     * \return false if there was no such timer
+     */
+    bool event_queue::implementation::cancel_timer(int timer_id)
+    {
+        return timers.cancel(timer_id);
+    }
+
+    /**
+     * Start delivering a signal as events
+     *
+     * The first signal opens the signalfd of the queue, the rest are
+     * added to its mask.
+     */
+    error_code event_queue::implementation::add_signal(int signal)
+    {
+        bool created = false;
+
+        error_code rval = signals.add(signal, created);
+        if (rval != error_code::success || not created)
+            return rval;
+
+        // closed again when it cannot be watched, so the next signal
+        // added tries with a new one
+        rval = register_native_source(signals.fd(), translator_entry{ .batch = &detail::signal_source::read }, nullptr, trigger_mode::level);
+        if (rval != error_code::success)
+        {
+            signals.remove(signal);
+            signals.close();
+        }
+
+        return rval;
+    }
+
+    /**
+     * Stop delivering a signal
+     *
+     * \return false if the signal was not added
+     */
+    bool event_queue::implementation::remove_signal(int signal)
+    {
+        return signals.remove(signal);
+    }
+
+    /**
+     * Arm the timerfd for the next slot of the wheel, unless it
+     * goes off before that anyway
+     */
+    void event_queue::implementation::arm_timer_fd() noexcept
+    {
+        const auto next = timers.next_wakeup();
+        if (not next || *next >= timer_armed)
+            return;
+
+        // steady_clock is CLOCK_MONOTONIC
+        const auto since_epoch = std::chrono::duration_cast<std::chrono::nanoseconds>(next->time_since_epoch());
+
+        itimerspec spec{};
+        spec.it_value.tv_sec = since_epoch.count() / 1'000'000'000;
+        spec.it_value.tv_nsec = since_epoch.count() % 1'000'000'000;
+
+        // all zeroes would disarm it
+        if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0)
+            spec.it_value.tv_nsec = 1;
+
+        if (timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &spec, nullptr) == 0)
+            timer_armed = *next;
+    }
+
+    /**
+     * Fire the timers that are due and arm the timerfd for the rest
+     *
+     * \return number of timer events dispatched
+     */
+    int event_queue::implementation::expire_timers()
+    {
+        uint64_t expirations;
+        if (::read(timer_fd, &expirations, sizeof(expirations)) != sizeof(expirations))
+            return 0;
+
+        timer_armed = detail::timer_wheel::clock::time_point::max();
+
+        const int fired = timers.advance(detail::timer_wheel::clock::now(), [this](const detail::timer_wheel::expiry& expiry) {
+            raw_event ev = event::timer{ expiry.timer_id, expiry.expirations, expiry.last_tick };
+            call(ev);
+        });
+
+        arm_timer_fd();
+
+        if (fired > 0)
+            timer_wakeups.fetch_add(1, std::memory_order_relaxed);
+        timer_wakeups_saved.store(timers.coalesced(), std::memory_order_relaxed);
+
+        return fired;
+    }
+
+    bool event_queue::implementation::dispatch_source(uint64_t data)
+    {
+        const native_source_type fd = source_fd(data);
+
+        // removed, and maybe replaced, by a handler earlier in the batch
+        source_record* source = find_source(fd);
+        if (source == nullptr || source->generation != source_generation(data))
+            return false;
+
+        // copied, translators and handlers may add sources and
+        // grow the table
+        const translator_entry translator = source->translator;
+
+        if (translator.batch != nullptr)
+            return translate_batch(translator.batch, fd) != 0;
+
+        if (translator.single == nullptr)
+            return resume_readiness_waiter(source->watch) != 0;
+
+        raw_event ev = translator.single(fd);
+
+        // empty events are special, since if we only get those,
+        // we do not break from blocking
+        if (get_event_details_for<empty_event>().event_id == ev.type())
+            return false;
+
+        call(ev);
+        return true;
+    }
+
+    /**
+     * Run a batch translator and dispatch everything it produced
+     *
+     * \return number of events dispatched
+     */
+    int event_queue::implementation::translate_batch(batch_translator_type func, native_source_type fd)
+    {
+        translated_events.clear();
+        func(fd, translated_events);
+
+        int count = 0;
+        for (raw_event& ev : translated_events)
+        {
+            if (get_event_details_for<empty_event>().event_id == ev.type())
+                continue;
+
+            call(ev);
+            count++;
+        }
+
+        translated_events.clear();
+
+        return count;
+    }
+
+    /**
+     * Push an event sent from another thread to the inbox
+     *
+     * Only the producer that finds the inbox empty wakes up the queue,
+     * the rest ride along on the same wakeup.
+     */
+    void event_queue::implementation::push_remote_event(raw_event ev)
+    {
+        inbox_node* node = new inbox_node{std::move(ev), nullptr};
+        inbox_node* head = inbox.load(std::memory_order_relaxed);
+
+        // the node belongs to the queue thread once pushed, so the old
+        // head is kept here instead of read back from node->next
+        do {
+            node->next = head;
+        } while (not inbox.compare_exchange_weak(head, node,
+                                                 std::memory_order_release,
+                                                 std::memory_order_relaxed));
+
+        if (head == nullptr)
+        {
+            remote_wakeups.fetch_add(1, std::memory_order_relaxed);
+            eventfd_write(notify_fd, 1);
+        }
+    }
+
+    /**
+     * Dispatch everything in the inbox, in the order it was sent
+     *
+     * \return number of events dispatched
+     */
+    int event_queue::implementation::dispatch_remote_events()
+    {
+        // reset the counter before taking the events, so that a producer
+        // finding the inbox empty after this always causes a new wakeup
+        eventfd_t value;
+        eventfd_read(notify_fd, &value);
+
+        inbox_node* node = inbox.exchange(nullptr, std::memory_order_acquire);
+
+        inbox_node* reversed = nullptr;
+        while (node != nullptr)
+        {
+            inbox_node* next = node->next;
+            node->next = reversed;
+            reversed = node;
+            node = next;
+        }
+
+        int count = 0;
+        while (reversed != nullptr)
+        {
+            if (reversed->ev.type() == event_type_id<queued_task>)
+                event_ref<queued_task>(reversed->ev).task();
+            else
+                call(reversed->ev);
+
+            delete std::exchange(reversed, reversed->next);
+            count++;
+        }
+
+        remote_events.fetch_add(count, std::memory_order_relaxed);
+
+        return count;
+    }
+
+    /**
+     * Handle sent event directly
+     *
+     * Events sent from a thread other than the one running the queue
+     * are handed over to it and handled on its next wakeup.
+     */
+    error_code event_queue::implementation::send_event(event_details type, raw_event ev)
+    {
+        (void)type;
+
+        if (not on_queue_thread())
+        {
+            push_remote_event(std::move(ev));
+            return error_code::success;
+        }
+
+        call(ev);
+        events_sent = true;
+
+        return error_code::success;
+    }
+
+    /**
+     * Queue an event to be handled on the next wait or poll
+     */
+    error_code event_queue::implementation::post_event(event_details type, raw_event ev)
+    {
+        (void)type;
+
+        if (not on_queue_thread())
+        {
+            push_remote_event(std::move(ev));
+            return error_code::success;
+        }
+
+        posted_events.push_back(std::move(ev));
+
+        return error_code::success;
+    }
+
+    /**
+     * Run a function on the thread running the queue
+     */
+    void event_queue::implementation::execute(task_type task)
+    {
+        if (on_queue_thread())
+        {
+            task();
+            return;
+        }
+
+        push_remote_event(queued_task{std::move(task)});
+    }
+
+    queue_statistics event_queue::implementation::statistics() const noexcept
+    {
+        queue_statistics stats{};
+
+        stats.remote_events = remote_events.load(std::memory_order_relaxed);
+        stats.remote_wakeups = remote_wakeups.load(std::memory_order_relaxed);
+        stats.full_batches = full_batches.load(std::memory_order_relaxed);
+        stats.batch_size = batch_size;
+        stats.poll_calls = poll_calls.load(std::memory_order_relaxed);
+        stats.timer_wakeups = timer_wakeups.load(std::memory_order_relaxed);
+        stats.timer_wakeups_saved = timer_wakeups_saved.load(std::memory_order_relaxed);
+
+        detail::event_pool::statistics pool_stats = pool.stats();
+        stats.pool_allocations = pool_stats.allocations;
+        stats.pool_slab_allocations = pool_stats.slab_allocations;
+        stats.pool_oversize_allocations = pool_stats.oversize_allocations;
+        stats.pool_remote_frees = pool_stats.remote_deallocations;
+
+        stats.buffer_allocations = pool_stats.buffer_allocations;
+        stats.buffer_slab_allocations = pool_stats.buffer_slab_allocations;
+        stats.buffer_remote_frees = pool_stats.buffer_remote_deallocations;
+
+        return stats;
+    }
+
+    /**
+     * Add a file description to the queue
+     */
+    error_code event_queue::implementation::add_native_source(native_source_type fd,
+                                                              translator_type func,
+                                                              destructor_type rfunc,
+                                                              trigger_mode mode)
+    {
+        return register_native_source(fd, translator_entry{ .single = func }, rfunc, mode);
+    }
+
+    /**
+     * Add a file description with a translator that can produce
+     * any number of events per wakeup
+     */
+    error_code event_queue::implementation::add_native_source(native_source_type fd,
+                                                              batch_translator_type func,
+                                                              destructor_type rfunc,
+                                                              trigger_mode mode)
+    {
+        return register_native_source(fd, translator_entry{ .batch = func }, rfunc, mode);
+    }
+
+    error_code event_queue::implementation::register_native_source(native_source_type fd,
+                                                                   translator_entry translator,
+                                                                   destructor_type rfunc,
+                                                                   trigger_mode mode)
+    {
+        if (fd < 0)
+            return error_code::system_error;
+
+        // a record left behind by a descriptor closed without removing
+        // it first, the kernel may have given the number to a new file
+        source_record stale{};
+        if (source_record* previous = find_source(fd); previous != nullptr)
+        {
+            if (not release_stale_source(fd, *previous))
+                return errno == EEXIST ? error_code::already_exists : error_code::system_error;
+            stale = *previous;
+        }
+
+        source_record& source = claim_source(fd, mode);
+        source.translator = translator;
+        source.destructor = rfunc;
+
+        if (not watch_source(fd, source))
+        {
+            const bool live = errno == EEXIST;
+            source = stale;
+            return live ? error_code::already_exists : error_code::system_error;
+        }
+
+        return error_code::success;
+    }
+
+    /**
+     * Take the record of a descriptor, with a generation of its own
+     */
+    event_queue::implementation::source_record& event_queue::implementation::claim_source(native_source_type fd, trigger_mode mode)
+    {
+        if (static_cast<std::size_t>(fd) >= sources.size())
+            sources.resize(fd + 1);
+
+        source_record& source = sources[fd];
+        source = source_record{};
+        source.mode = mode;
+        source.generation = next_generation++;
+
+        if (next_generation == 0 || next_generation == ~uint32_t(0))
+            next_generation = 1;
+
+        return source;
+    }
+
+    /**
+     * Stop watching a descriptor, with or without a translator
+     */
+    void event_queue::implementation::remove_native_source(native_source_type fd)
+    {
+        source_record* source = find_source(fd);
+        if (source == nullptr)
+            return;
+
+        unwatch_source(fd, *source);
+        *source = source_record{};
+    }
+
+    /**
+     * Suspend a coroutine until a descriptor is readable
+     *
+     * The descriptor is watched edge triggered from the first await
+     * until removed with remove_native_source.
+     *
+     * \return false if the coroutine should not suspend, result tells why
+     */
+    bool event_queue::implementation::await_readable(native_source_type fd, detail::readiness_waiter& waiter, error_code& result)
+    {
+        result = error_code::already_exists;
+
+        source_record* source = find_source(fd);
+        if (source != nullptr && (source->translator.single != nullptr || source->translator.batch != nullptr))
+            return false;
+
+        if (source == nullptr)
+        {
+            result = error_code::system_error;
+            if (fd < 0)
+                return false;
+
+            source = &claim_source(fd, trigger_mode::edge);
+
+            if (not watch_source(fd, *source))
+            {
+                *source = source_record{};
+                return false;
+            }
+
+            result = error_code::already_exists;
+        }
+
+        readiness_watch& watch = source->watch;
+
+        // someone else is waiting on it already
+        if (watch.waiter != nullptr)
+            return false;
+
+        result = error_code::success;
+
+        if (watch.ready)
+        {
+            watch.ready = false;
+            return false;
+        }
+
+        watch.waiter = &waiter;
+        return true;
+    }
+}
+/*
+    Copyright (c) 2021 Jari Ronkainen
+
+    This software is provided 'as-is', without any express or implied warranty.
+    In no event will the authors be held liable for any damages arising from the
+    use of this software.
+
+    Permission is granted to anyone to use this software for any purpose, including
+    commercial applications, and to alter it and redistribute it freely, subject to
+    the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not claim
+       that you wrote the original software. If you use this software in a product,
+       an acknowledgment in the product documentation would be appreciated but is
+       not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+       misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source distribution.
+*/
@@ -0,0 +1,173 @@
+/*!
+ *  \file       event_queue_group.cpp
+ *  \brief      thread-per-core group of event queues for Linux
+ *  \author     Jari Ronkainen
+ *  \version    0.1
+ */
+#include <cppevents/event_queue_group.hpp>
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <latch>
+
+namespace cppevents
+{
+    static void pin_to_cpu(std::size_t cpu)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+
+        int rval = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (rval != 0)
+            std::cerr << "ERROR: could not pin shard thread to cpu " << cpu << ": " << std::strerror(rval) << "\n";
+    }
+
+    event_queue_group::event_queue_group(std::size_t count, bool pin_threads)
+    {
+        const std::size_t cpus = std::max(1u, std::thread::hardware_concurrency());
+
+        if (count == 0)
+            count = cpus;
+
+        std::latch ready(count);
+
+        shards.reserve(count);
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            shard_state* state = shards.emplace_back(std::make_unique<shard_state>()).get();
+
+            state->thread = std::thread([state, &ready, pin_threads, cpu = i % cpus] {
+                if (pin_threads)
+                    pin_to_cpu(cpu);
+
+                // the queue is created here so that its memory and its
+                // pool belong to the thread and the cpu running it
+                state->queue = std::make_unique<event_queue>();
+                state->thread_id = std::this_thread::get_id();
+                ready.count_down();
+
+                while (not state->stopping)
+                    state->queue->wait();
+
+                state->queue.reset();
+            });
+        }
+
+        ready.wait();
+    }
+
+    event_queue_group::~event_queue_group()
+    {
+        stop();
+    }
+
+    void event_queue_group::stop()
+    {
+        for (auto& state : shards)
+        {
+            if (not state->thread.joinable())
+                continue;
+
+            shard_state* ptr = state.get();
+            state->queue->execute([ptr] { ptr->stopping = true; });
+            state->thread.join();
+        }
+    }
+
+    void event_queue_group::remove_native_source(native_source_type fd)
+    {
+        std::size_t index;
+        {
+            std::lock_guard<std::mutex> lock(sources_lock);
+
+            auto it = source_shards.find(fd);
+            if (it == source_shards.end())
+                return;
+
+            index = it->second;
+            source_shards.erase(it);
+        }
+
+        run_on(index, [&] { shard(index).remove_native_source(fd); });
+        shards[index]->sources.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    /**
+     * Count a source added to a shard
+     *
+     * A descriptor closed without removing it may come back on another
+     * shard, it stops counting on the old one.
+     */
+    void event_queue_group::track_source(native_source_type fd, std::size_t index)
+    {
+        std::lock_guard<std::mutex> lock(sources_lock);
+
+        auto [it, inserted] = source_shards.try_emplace(fd, index);
+        if (not inserted)
+        {
+            shards[it->second]->sources.fetch_sub(1, std::memory_order_relaxed);
+            it->second = index;
+        }
+
+        shards[index]->sources.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    bool event_queue_group::on_other_shard(std::size_t index) const noexcept
+    {
+        const std::thread::id self = std::this_thread::get_id();
+
+        for (std::size_t i = 0; i < shards.size(); ++i)
+            if (i != index && shards[i]->thread_id == self)
+                return true;
+
+        return false;
+    }
+
+    std::size_t event_queue_group::pick_shard(shard_policy policy, std::size_t requested) noexcept
+    {
+        switch (policy)
+        {
+            case shard_policy::explicit_shard:
+                return requested % shards.size();
+
+            case shard_policy::least_loaded:
+            {
+                std::size_t best = 0;
+                for (std::size_t i = 1; i < shards.size(); ++i)
+                    if (load(i) < load(best))
+                        best = i;
+                return best;
+            }
+
+            case shard_policy::round_robin:
+            default:
+                return next_shard.fetch_add(1, std::memory_order_relaxed) % shards.size();
+        }
+    }
+}
+/*
+    Copyright (c) 2021 Jari Ronkainen
+
+    This software is provided 'as-is', without any express or implied warranty.
+    In no event will the authors be held liable for any damages arising from the
+    use of this software.
+
+    Permission is granted to anyone to use this software for any purpose, including
+    commercial applications, and to alter it and redistribute it freely, subject to
+    the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not claim
+       that you wrote the original software. If you use this software in a product,
+       an acknowledgment in the product documentation would be appreciated but is
+       not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+       misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source distribution.
+*/
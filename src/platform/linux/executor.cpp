@@ -0,0 +1,188 @@
+/*!
+ *  \file       executor.cpp
+ *  \brief      work-stealing thread pool for offloaded event handlers
+ *  \author     Jari Ronkainen
+ *  \version    0.1
+ */
+#include <cppevents/executor.hpp>
+
+#include <algorithm>
+
+namespace cppevents
+{
+    // worker of the calling thread, tasks it submits stay local
+    static thread_local std::size_t current_worker = static_cast<std::size_t>(-1);
+    static thread_local executor* current_executor = nullptr;
+
+    executor::executor(std::size_t count)
+    {
+        if (count == 0)
+            count = std::max(1u, std::thread::hardware_concurrency());
+
+        workers.reserve(count);
+        for (std::size_t i = 0; i < count; ++i)
+            workers.emplace_back(std::make_unique<worker>());
+
+        for (std::size_t i = 0; i < count; ++i)
+            workers[i]->thread = std::thread([this, i] { run(i); });
+    }
+
+    executor::~executor()
+    {
+        stopping.store(true);
+
+        // wake everyone, the count is never waited on again
+        pending.fetch_add(1);
+        pending.notify_all();
+
+        for (auto& w : workers)
+            w->thread.join();
+    }
+
+    void executor::submit(task_type task)
+    {
+        std::size_t index;
+        if (current_executor == this)
+            index = current_worker;
+        else
+            index = next_worker.fetch_add(1, std::memory_order_relaxed) % workers.size();
+
+        {
+            std::lock_guard<std::mutex> guard(workers[index]->lock);
+            workers[index]->tasks.push_back(std::move(task));
+        }
+
+        // pairs with the sleeper count going up before the worker
+        // checks the pending count, both sequentially consistent
+        pending.fetch_add(1);
+        if (sleepers.load() > 0)
+            pending.notify_one();
+    }
+
+    bool executor::take(std::size_t index, task_type& task)
+    {
+        {
+            worker& own = *workers[index];
+            std::lock_guard<std::mutex> guard(own.lock);
+            if (not own.tasks.empty())
+            {
+                task = std::move(own.tasks.front());
+                own.tasks.pop_front();
+                pending.fetch_sub(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+
+        for (std::size_t i = 1; i < workers.size(); ++i)
+        {
+            worker& victim = *workers[(index + i) % workers.size()];
+            std::lock_guard<std::mutex> guard(victim.lock);
+            if (not victim.tasks.empty())
+            {
+                task = std::move(victim.tasks.back());
+                victim.tasks.pop_back();
+                pending.fetch_sub(1, std::memory_order_relaxed);
+                stolen.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    void executor::run(std::size_t index)
+    {
+        current_worker = index;
+        current_executor = this;
+
+        task_type task;
+        while (true)
+        {
+            if (take(index, task))
+            {
+                task();
+                task = nullptr;
+                continue;
+            }
+
+            if (stopping.load())
+                break;
+
+            // a task may be counted but not yet taken by whoever
+            // is holding it, only sleep when there is nothing at all
+            sleepers.fetch_add(1);
+            pending.wait(0);
+            sleepers.fetch_sub(1);
+        }
+    }
+
+    namespace detail
+    {
+        // drained events per task, so that one busy type cannot keep
+        // a worker to itself
+        static constexpr int drain_limit = 64;
+
+        void offloaded_handler::handle(raw_event&& ev)
+        {
+            workers.submit([self = shared_from_this(), ev = std::move(ev)]() mutable {
+                self->callback(ev);
+            });
+        }
+
+        void offloaded_handler::handle_ordered(raw_event&& ev)
+        {
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                backlog.push_back(std::move(ev));
+
+                if (draining)
+                    return;
+                draining = true;
+            }
+
+            workers.submit([self = shared_from_this()] { self->drain(); });
+        }
+
+        void offloaded_handler::drain()
+        {
+            for (int i = 0; i < drain_limit; ++i)
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                if (backlog.empty())
+                {
+                    draining = false;
+                    return;
+                }
+
+                raw_event ev = std::move(backlog.front());
+                backlog.pop_front();
+                guard.unlock();
+
+                callback(ev);
+            }
+
+            workers.submit([self = shared_from_this()] { self->drain(); });
+        }
+    }
+}
+/*
+    Copyright (c) 2021 Jari Ronkainen
+
+    This software is provided 'as-is', without any express or implied warranty.
+    In no event will the authors be held liable for any damages arising from the
+    use of this software.
+
+    Permission is granted to anyone to use this software for any purpose, including
+    commercial applications, and to alter it and redistribute it freely, subject to
+    the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not claim
+       that you wrote the original software. If you use this software in a product,
+       an acknowledgment in the product documentation would be appreciated but is
+       not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+       misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source distribution.
+*/
@@ -1,34 +1,953 @@
+/*!
+ *  \file       filesystem.cpp
+ *  \brief      filesystem watching for linux
+ *  \author     Jari Ronkainen
+ *  \version    0.3
+ *
+ *  Directory watching on top of inotify, or fanotify for whole
+ *  filesystems.  Events are read in large chunks, and everything that
+ *  happens to an entry during one wakeup of the queue is merged into
+ *  a single event.
+ */
 #include <cppevents/filesystem.hpp>
 
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include <climits>
+#include <cstddef>
+
+#include <linux/capability.h>
 
 #include <unistd.h>
 #include <fcntl.h>
+#include <sys/fanotify.h>
 #include <sys/inotify.h>
+#include <sys/statfs.h>
+#include <sys/syscall.h>
 
 namespace cppevents
 {
-    constexpr static int UNINITIALISED_FILE_DESCRIPTOR = -2;
+    namespace
+    {
+        /*
+         * Append-only storage for strings, each stored once
+         *
+         * Strings are kept NUL terminated in large chunks that are never
+         * moved, so the pointers handed out stay valid until the arena is
+         * cleared or destroyed.
+         */
+        class string_arena
+        {
+            public:
+                //! Forget every string, the first chunk is kept for reuse
+                void clear() noexcept
+                {
+                    strings.clear();
+                    if (chunks.empty())
+                        return;
+
+                    chunks.resize(1);
+                    chunk_next = chunks.front().get();
+                    chunk_left = first_chunk_size;
+                }
+
+                const char* intern(std::string_view str)
+                {
+                    if (auto it = strings.find(str); it != strings.end())
+                        return it->data();
+
+                    if (str.size() + 1 > chunk_left)
+                    {
+                        const std::size_t size = std::max(str.size() + 1, chunk_size);
+                        if (chunks.empty())
+                            first_chunk_size = size;
+                        chunks.push_back(std::make_unique<char[]>(size));
+                        chunk_next = chunks.back().get();
+                        chunk_left = size;
+                    }
+
+                    char* stored = chunk_next;
+                    std::memcpy(stored, str.data(), str.size());
+                    stored[str.size()] = '\0';
+
+                    chunk_next += str.size() + 1;
+                    chunk_left -= str.size() + 1;
+
+                    strings.insert(std::string_view(stored, str.size()));
+                    return stored;
+                }
+
+            private:
+                static constexpr std::size_t chunk_size = 64 * 1024;
+
+                std::vector<std::unique_ptr<char[]>> chunks;
+                char* chunk_next = nullptr;
+                std::size_t chunk_left = 0;
+                std::size_t first_chunk_size = 0;
+
+                std::unordered_set<std::string_view> strings;
+        };
+
+        constexpr uint32_t inotify_mask = IN_CREATE | IN_MODIFY | IN_ATTRIB | IN_DELETE
+                                        | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF
+                                        | IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK;
+
+        constexpr uint64_t fanotify_mask = FAN_CREATE | FAN_MODIFY | FAN_ATTRIB | FAN_DELETE
+                                         | FAN_MOVED_FROM | FAN_MOVED_TO | FAN_ONDIR;
 
-    struct inotify_instance
+        // kept without the trailing slash, names are appended to it
+        std::string_view trim_path(std::string_view path) noexcept
+        {
+            while (path.size() > 1 && path.back() == '/')
+                path.remove_suffix(1);
+            return path;
+        }
+    }
+
+    /*
+     * What both backends share: the queue registration, the names and
+     * merging the changes of a wakeup
+     */
+    class filesystem_watcher::implementation
     {
-        inotify_instance();
-        ~inotify_instance();
+        public:
+            implementation(event_queue& queue, native_source_type fd);
+            virtual ~implementation();
+
+            implementation(const implementation&) = delete;
+            implementation& operator=(const implementation&) = delete;
+
+            virtual error_code watch(std::string_view path, bool recursive) = 0;
+            virtual std::size_t size() const noexcept = 0;
+            virtual filesystem_backend backend() const noexcept = 0;
+
+            static void translate(native_source_type fd, event_buffer& events);
+
+        protected:
+            // called with everything a single read returned
+            virtual void parse(const char* data, std::size_t size) = 0;
+
+            void record_change(const char* directory, const char* name, uint32_t changes, bool is_directory);
+            void record_overflow();
+
+            event_queue& queue;
+            native_source_type fd;
+
+            // why watching fails, set when the watcher could not be set up
+            error_code status = error_code::success;
+
+            // directories and names of the entries in the events of the
+            // current wakeup, cleared once the queue has handled them
+            string_arena names;
+            std::string scratch_path;
+
+        private:
+            void read_events(event_buffer& events);
+
+            // changes of the current wakeup, merged per entry.  paths and
+            // names are interned, so the pointers identify them
+            struct entry_key
+            {
+                const char* directory;
+                const char* name;
+
+                bool operator==(const entry_key&) const noexcept = default;
+            };
 
-        // this is the thing event_queue needs
-        int descriptor = UNINITIALISED_FILE_DESCRIPTOR;
+            struct entry_hash
+            {
+                std::size_t operator()(const entry_key& key) const noexcept
+                {
+                    return std::hash<const void*>{}(key.directory) * 31 + std::hash<const void*>{}(key.name);
+                }
+            };
+
+            std::unordered_map<entry_key, std::size_t, entry_hash> pending_index;
+            std::vector<filesystem_event> pending;
+
+            // read buffer, large enough for a few thousand records
+            static constexpr std::size_t buffer_size = 256 * 1024;
+            std::unique_ptr<char[]> buffer;
     };
 
-    static inotify_instance notifier;
+    namespace
+    {
+        /*
+         * One watch per directory, subdirectories are found by walking
+         * the tree and followed as they are created
+         */
+        class inotify_watcher final : public filesystem_watcher::implementation
+        {
+            public:
+                inotify_watcher(event_queue& queue, native_source_type fd) : implementation(queue, fd) {}
+
+                error_code watch(std::string_view path, bool recursive) override;
+                std::size_t size() const noexcept override { return watched; }
+                filesystem_backend backend() const noexcept override { return filesystem_backend::inotify; }
+
+            protected:
+                void parse(const char* data, std::size_t size) override;
+
+            private:
+                struct directory
+                {
+                    std::string path;
+                    bool recursive = false;
+                    bool root = false;
+                };
+
+                error_code add_directory(std::string_view path, bool recursive, bool root, int* wd_out = nullptr);
+                error_code add_tree(std::string_view path, bool root);
+                void forget_tree(std::string_view path);
+                void unindex(int wd, const directory& dir);
+
+                // by watch descriptor, and the same by path to find a
+                // directory and everything below it when it is moved.
+                // the kernel never hands out a descriptor twice, entries
+                // go away when the watch does
+                std::unordered_map<int, directory> directories;
+                std::map<std::string_view, int> directory_paths;
+                std::size_t watched = 0;
+        };
+
+        /*
+         * One mark for a whole filesystem, events name the directory by
+         * a file handle that is resolved to a path once and cached
+         */
+        class fanotify_watcher final : public filesystem_watcher::implementation
+        {
+            public:
+                fanotify_watcher(event_queue& queue, native_source_type fd) : implementation(queue, fd) {}
+                ~fanotify_watcher() override;
+
+                error_code watch(std::string_view path, bool recursive) override;
+                std::size_t size() const noexcept override { return roots.size(); }
+                filesystem_backend backend() const noexcept override { return filesystem_backend::fanotify; }
+
+                //! Whether the process may mark filesystems and open file handles
+                static bool available() noexcept;
+
+            protected:
+                void parse(const char* data, std::size_t size) override;
+
+            private:
+                struct root
+                {
+                    std::string_view path;
+                    bool recursive;
+                };
+
+                struct mount
+                {
+                    __kernel_fsid_t fsid;
+                    int fd;
+                };
+
+                // a directory found by its handle.  the ones outside the
+                // watched trees are kept too, so their events are dropped
+                // without resolving them again
+                struct cached_directory
+                {
+                    std::string path;
+                    bool watched;
+                };
+
+                const mount* find_mount(const __kernel_fsid_t& fsid) const noexcept;
+                const cached_directory* resolve_directory(const mount& m, file_handle* handle);
+                bool is_watched(std::string_view path) const noexcept;
+                void forget_directories(std::string_view path);
+
+                std::vector<root> roots;
+                std::vector<mount> mounts;
+
+                // paths of the roots, kept for the watcher
+                string_arena paths;
+
+                // file system id and handle to the directory, and the same
+                // ordered by path to find a directory and everything below
+                // it when it is moved or deleted
+                std::unordered_map<std::string, cached_directory> directories;
+                std::multimap<std::string_view, const std::string*> directory_paths;
+                std::string scratch_key;
+
+                static constexpr std::size_t max_cached_directories = 64 * 1024;
+        };
+    }
+
+    // translators are plain functions, they find their watcher through this
+    static std::mutex watchers_lock;
+    static std::unordered_map<native_source_type, filesystem_watcher::implementation*> watchers;
+
+    static std::unique_ptr<filesystem_watcher::implementation> make_watcher(event_queue& queue, filesystem_backend backend)
+    {
+        if (backend == filesystem_backend::fanotify && fanotify_watcher::available())
+        {
+            int fd = ::fanotify_init(FAN_CLASS_NOTIF | FAN_REPORT_DFID_NAME | FAN_CLOEXEC | FAN_NONBLOCK,
+                                     O_RDONLY | O_CLOEXEC | O_LARGEFILE);
+            if (fd != -1)
+                return std::make_unique<fanotify_watcher>(queue, fd);
+        }
+
+        int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (fd == -1)
+            std::cerr << "ERROR: could not create an inotify instance: " << std::strerror(errno) << "\n";
+
+        return std::make_unique<inotify_watcher>(queue, fd);
+    }
+
+    filesystem_watcher::filesystem_watcher(event_queue& queue, filesystem_backend backend) : impl(make_watcher(queue, backend)) {}
+    filesystem_watcher::~filesystem_watcher() = default;
 
-    inotify_instance::inotify_instance()
+    error_code filesystem_watcher::watch(std::string_view path, bool recursive) { return impl->watch(path, recursive); }
+    std::size_t filesystem_watcher::size() const noexcept { return impl->size(); }
+    filesystem_backend filesystem_watcher::backend() const noexcept { return impl->backend(); }
+
+    filesystem_watcher::implementation::implementation(event_queue& queue, native_source_type fd) : queue{queue}, fd{fd}
     {
-        notifier.descriptor = inotify_init();
+        if (fd == -1)
+        {
+            status = error_code::system_error;
+            return;
+        }
+
+        buffer = std::make_unique<char[]>(buffer_size);
+
+        {
+            std::lock_guard<std::mutex> lock(watchers_lock);
+            watchers[fd] = this;
+        }
+
+        status = queue.add_native_source(fd, &implementation::translate);
+        if (status == error_code::success)
+            return;
+
+        std::cerr << "ERROR: could not add the filesystem watcher to the queue\n";
+
+        {
+            std::lock_guard<std::mutex> lock(watchers_lock);
+            watchers.erase(fd);
+        }
+
+        ::close(std::exchange(this->fd, -1));
     }
 
-    inotify_instance::~inotify_instance()
+    filesystem_watcher::implementation::~implementation()
     {
-        if (notifier.descriptor >= 0)
-            close(notifier.descriptor);
+        if (fd == -1)
+            return;
+
+        queue.remove_native_source(fd);
+
+        {
+            std::lock_guard<std::mutex> lock(watchers_lock);
+            watchers.erase(fd);
+        }
+
+        ::close(fd);
     }
+
+    void filesystem_watcher::implementation::translate(native_source_type fd, event_buffer& events)
+    {
+        implementation* watcher = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(watchers_lock);
+            if (auto it = watchers.find(fd); it != watchers.end())
+                watcher = it->second;
+        }
+
+        if (watcher != nullptr)
+            watcher->read_events(events);
+    }
+
+    /**
+     * Read everything pending and turn it into one event per entry
+     */
+    void filesystem_watcher::implementation::read_events(event_buffer& events)
+    {
+        // the events of the previous wakeup have been handled by now
+        names.clear();
+
+        // bounded, under a storm the rest is left for the next wakeup
+        // so the queue gets to handle something else in between
+        for (int reads = 0; reads < 16; ++reads)
+        {
+            ssize_t bytes = ::read(fd, buffer.get(), buffer_size);
+            if (bytes <= 0)
+                break;
+
+            parse(buffer.get(), static_cast<std::size_t>(bytes));
+
+            if (static_cast<std::size_t>(bytes) < buffer_size / 2)
+                break;
+        }
+
+        for (filesystem_event& ev : pending)
+            events.push_back(ev);
+
+        pending.clear();
+        pending_index.clear();
+    }
+
+    void filesystem_watcher::implementation::record_change(const char* directory, const char* name, uint32_t changes, bool is_directory)
+    {
+        auto [it, inserted] = pending_index.try_emplace(entry_key{directory, name}, pending.size());
+        if (inserted)
+        {
+            filesystem_event ev;
+            ev.directory = directory;
+            ev.name = name;
+            ev.is_directory = is_directory;
+            pending.push_back(ev);
+        }
+
+        pending[it->second].changes |= changes;
+    }
+
+    void filesystem_watcher::implementation::record_overflow()
+    {
+        filesystem_event ev;
+        ev.changes = filesystem_event::overflow;
+        pending.push_back(ev);
+    }
+
+    /**
+     * Watch a directory, and with recursive every directory below it
+     */
+    error_code inotify_watcher::watch(std::string_view path, bool recursive)
+    {
+        if (status != error_code::success)
+            return status;
+
+        if (recursive)
+            return add_tree(trim_path(path), true);
+
+        return add_directory(trim_path(path), false, true);
+    }
+
+    error_code inotify_watcher::add_directory(std::string_view path, bool recursive, bool root, int* wd_out)
+    {
+        scratch_path.assign(path);
+        int wd = inotify_add_watch(fd, scratch_path.c_str(), inotify_mask);
+        if (wd == -1)
+            return error_code::system_error;
+
+        if (wd_out != nullptr)
+            *wd_out = wd;
+
+        auto [it, inserted] = directories.try_emplace(wd);
+        directory& dir = it->second;
+
+        if (inserted)
+            watched++;
+
+        // the same directory reached by another path, e.g. through a
+        // bind mount, is known by the latest one
+        if (dir.path != path)
+        {
+            if (not inserted)
+                unindex(wd, dir);
+            dir.path.assign(path);
+
+            // the key points into the directory, one left by a directory
+            // gone from the same path is replaced instead of reused
+            directory_paths.erase(dir.path);
+            directory_paths.emplace(dir.path, wd);
+        }
+
+        // the same directory reached twice keeps the wider setting
+        dir.recursive |= recursive;
+        dir.root |= root;
+
+        return error_code::success;
+    }
+
+    void inotify_watcher::unindex(int wd, const directory& dir)
+    {
+        if (auto it = directory_paths.find(dir.path); it != directory_paths.end() && it->second == wd)
+            directory_paths.erase(it);
+    }
+
+    /**
+     * Stop watching a directory that moved, and everything below it
+     *
+     * Their paths are no longer right.  The kernel confirms each removal
+     * with IN_IGNORED, found for no directory by then.  A directory moved
+     * within the tree is watched again from its new path.
+     */
+    void inotify_watcher::forget_tree(std::string_view path)
+    {
+        auto forget = [this](auto first, auto last) {
+            while (first != last)
+            {
+                const int wd = first->second;
+                first = directory_paths.erase(first);
+
+                inotify_rm_watch(fd, wd);
+                directories.erase(wd);
+                watched--;
+            }
+        };
+
+        // the key points into the directory, copied before erasing it
+        std::string prefix(path);
+
+        auto exact = directory_paths.find(prefix);
+        if (exact != directory_paths.end())
+            forget(exact, std::next(exact));
+
+        // '0' sorts right after '/'
+        prefix.append("/");
+        auto below = directory_paths.lower_bound(prefix);
+        prefix.back() = '0';
+        forget(below, directory_paths.lower_bound(prefix));
+    }
+
+    /**
+     * Watch a directory and everything below it
+     *
+     * Directories that vanish or cannot be read while walking are
+     * skipped, only failing to watch the top one is an error.  A tree
+     * that appeared while watching is announced entry by entry, since
+     * whatever was created in it before its watch was added is never
+     * reported by inotify.
+     */
+    error_code inotify_watcher::add_tree(std::string_view path, bool root)
+    {
+        int wd = -1;
+        error_code rval = add_directory(path, true, root, &wd);
+        if (rval != error_code::success)
+            return rval;
+
+        // watch of the directory at each depth of the walk
+        std::vector<int> parents{ wd };
+
+        std::error_code error;
+        auto options = std::filesystem::directory_options::skip_permission_denied;
+
+        for (auto it = std::filesystem::recursive_directory_iterator(std::filesystem::path(path), options, error);
+             not error && it != std::filesystem::recursive_directory_iterator();
+             it.increment(error))
+        {
+            // symlinks are not followed, the file type is cached by
+            // the iterator so files cost no system call
+            std::error_code type_error;
+            const bool is_directory = it->is_directory(type_error) && not it->is_symlink(type_error);
+
+            const int parent = parents[std::min<std::size_t>(it.depth(), parents.size() - 1)];
+
+            if (not root && parent >= 0)
+            {
+                const char* directory = names.intern(directories[parent].path);
+                record_change(directory, names.intern(it->path().filename().native()), filesystem_event::created, is_directory);
+            }
+
+            if (not is_directory)
+                continue;
+
+            parents.resize(it.depth() + 2, -1);
+            if (add_directory(it->path().native(), true, false, &parents[it.depth() + 1]) != error_code::success)
+                it.disable_recursion_pending();
+        }
+
+        return error_code::success;
+    }
+
+    void inotify_watcher::parse(const char* data, std::size_t size)
+    {
+        std::size_t offset = 0;
+        while (offset + sizeof(inotify_event) <= size)
+        {
+            inotify_event record;
+            std::memcpy(&record, data + offset, sizeof(record));
+
+            const char* record_name = data + offset + sizeof(inotify_event);
+            offset += sizeof(inotify_event) + record.len;
+
+            if (record.mask & IN_Q_OVERFLOW)
+            {
+                record_overflow();
+                continue;
+            }
+
+            // removed already, e.g. moved away earlier in the same read
+            auto found = directories.find(record.wd);
+            if (found == directories.end())
+                continue;
+
+            directory& dir = found->second;
+
+            if (record.mask & IN_IGNORED)
+            {
+                unindex(record.wd, dir);
+                directories.erase(found);
+                watched--;
+                continue;
+            }
+
+            const bool is_directory = record.mask & IN_ISDIR;
+            const char* directory_path = names.intern(dir.path);
+
+            // the directory itself going away is reported by its parent,
+            // unless nobody is watching the parent.  one moved away is not
+            // found by its path any more
+            if (record.mask & (IN_DELETE_SELF | IN_MOVE_SELF))
+            {
+                if (dir.root)
+                    record_change(directory_path, "", (record.mask & IN_DELETE_SELF) ? filesystem_event::deleted : filesystem_event::moved_from, true);
+                if (record.mask & IN_MOVE_SELF)
+                    forget_tree(directory_path);
+                continue;
+            }
+
+            // the name is padded with NULs to the record length
+            const char* name = names.intern(std::string_view(record_name, strnlen(record_name, record.len)));
+
+            uint32_t changes = 0;
+            if (record.mask & IN_CREATE)      changes |= filesystem_event::created;
+            if (record.mask & IN_MODIFY)      changes |= filesystem_event::modified;
+            if (record.mask & IN_ATTRIB)      changes |= filesystem_event::attributes;
+            if (record.mask & IN_DELETE)      changes |= filesystem_event::deleted;
+            if (record.mask & IN_MOVED_FROM)  changes |= filesystem_event::moved_from;
+            if (record.mask & IN_MOVED_TO)    changes |= filesystem_event::moved_to;
+
+            if (changes == 0)
+                continue;
+
+            const bool recursive = dir.recursive;
+            record_change(directory_path, name, changes, is_directory);
+
+            // found again by add_tree if it was moved within the tree
+            if (is_directory && (record.mask & IN_MOVED_FROM))
+            {
+                std::string moved = std::string(directory_path).append("/").append(name);
+                forget_tree(moved);
+            }
+
+            if (is_directory && recursive && (record.mask & (IN_CREATE | IN_MOVED_TO)))
+            {
+                std::string added = std::string(directory_path).append("/").append(name);
+                add_tree(added, false);
+            }
+        }
+    }
+
+    bool fanotify_watcher::available() noexcept
+    {
+        __user_cap_header_struct header{ _LINUX_CAPABILITY_VERSION_3, 0 };
+        __user_cap_data_struct data[_LINUX_CAPABILITY_U32S_3] = {};
+
+        if (::syscall(SYS_capget, &header, data) == -1)
+            return false;
+
+        // marking whole filesystems, and opening the directories the
+        // events point to by their handles
+        constexpr uint32_t needed = (1u << CAP_SYS_ADMIN) | (1u << CAP_DAC_READ_SEARCH);
+        return (data[0].effective & needed) == needed;
+    }
+
+    fanotify_watcher::~fanotify_watcher()
+    {
+        for (const mount& m : mounts)
+            ::close(m.fd);
+    }
+
+    /**
+     * Mark the filesystem the directory is on, or with recursive off
+     * just the directory
+     *
+     * Nothing below the directory is visited, so watching costs the same
+     * for any size of tree.  The paths are canonicalised, events are
+     * reported with the directories resolved by the kernel.
+     */
+    error_code fanotify_watcher::watch(std::string_view path, bool recursive)
+    {
+        if (status != error_code::success)
+            return status;
+
+        std::error_code error;
+        const std::filesystem::path canonical = std::filesystem::canonical(std::filesystem::path(path), error);
+        if (error)
+            return error_code::system_error;
+
+        // anything on the filesystem serves to open the handles of it,
+        // but not through an O_PATH descriptor
+        int mount_fd = ::open(canonical.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (mount_fd == -1)
+            return error_code::system_error;
+
+        struct statfs info;
+        if (::fstatfs(mount_fd, &info) == -1)
+        {
+            ::close(mount_fd);
+            return error_code::system_error;
+        }
+
+        __kernel_fsid_t fsid;
+        std::memcpy(&fsid, &info.f_fsid, sizeof(fsid));
+
+        const unsigned int flags = FAN_MARK_ADD | (recursive ? FAN_MARK_FILESYSTEM : FAN_MARK_ONLYDIR);
+        const uint64_t mask = fanotify_mask | (recursive ? 0 : FAN_EVENT_ON_CHILD);
+
+        if (::fanotify_mark(fd, flags, mask, AT_FDCWD, canonical.c_str()) == -1)
+        {
+            ::close(mount_fd);
+            return error_code::system_error;
+        }
+
+        if (find_mount(fsid) == nullptr)
+            mounts.push_back(mount{fsid, mount_fd});
+        else
+            ::close(mount_fd);
+
+        roots.push_back(root{ paths.intern(trim_path(canonical.native())), recursive });
+
+        // cached directories were judged against the roots before this one
+        directories.clear();
+        directory_paths.clear();
+
+        return error_code::success;
+    }
+
+    const fanotify_watcher::mount* fanotify_watcher::find_mount(const __kernel_fsid_t& fsid) const noexcept
+    {
+        for (const mount& m : mounts)
+            if (std::memcmp(&m.fsid, &fsid, sizeof(fsid)) == 0)
+                return &m;
+        return nullptr;
+    }
+
+    //! Whether a directory is a root or, for recursive roots, below one
+    bool fanotify_watcher::is_watched(std::string_view path) const noexcept
+    {
+        for (const root& r : roots)
+        {
+            if (path.size() == r.path.size() ? path == r.path
+                                             : r.recursive && path.starts_with(r.path)
+                                               && (r.path.size() == 1 || path[r.path.size()] == '/'))
+                return true;
+        }
+        return false;
+    }
+
+    /**
+     * Path of a directory from its handle, and whether it is watched
+     *
+     * Opening by handle and asking the path back takes three system calls,
+     * so the directories are cached, whether watched or not.  Renaming or
+     * removing a directory changes the paths of everything below it, those
+     * are forgotten with forget_directories.
+     */
+    const fanotify_watcher::cached_directory* fanotify_watcher::resolve_directory(const mount& m, file_handle* handle)
+    {
+        scratch_key.assign(reinterpret_cast<const char*>(&m.fsid), sizeof(m.fsid));
+        scratch_key.append(reinterpret_cast<const char*>(handle), sizeof(file_handle) + handle->handle_bytes);
+
+        if (auto it = directories.find(scratch_key); it != directories.end())
+            return &it->second;
+
+        int dir_fd = ::open_by_handle_at(m.fd, handle, O_PATH | O_CLOEXEC);
+        if (dir_fd == -1)
+            return nullptr;
+
+        char link[32];
+        std::snprintf(link, sizeof(link), "/proc/self/fd/%d", dir_fd);
+
+        char target[PATH_MAX];
+        ssize_t length = ::readlink(link, target, sizeof(target));
+        ::close(dir_fd);
+
+        // gone already, left out of the cache so a handle reused for a
+        // new directory is not resolved to the old one
+        if (length <= 0 || static_cast<std::size_t>(length) >= sizeof(target))
+            return nullptr;
+
+        if (directories.size() >= max_cached_directories)
+        {
+            directories.clear();
+            directory_paths.clear();
+        }
+
+        const std::string_view path(target, length);
+        auto [it, inserted] = directories.try_emplace(scratch_key, cached_directory{ std::string(path), is_watched(path) });
+        directory_paths.emplace(it->second.path, &it->first);
+
+        return &it->second;
+    }
+
+    /**
+     * Forget a directory that was moved or deleted, with everything
+     * cached below it
+     */
+    void fanotify_watcher::forget_directories(std::string_view path)
+    {
+        auto forget = [this](auto first, auto last) {
+            while (first != last)
+            {
+                auto cached = directories.find(*first->second);
+                first = directory_paths.erase(first);
+                directories.erase(cached);
+            }
+        };
+
+        auto [first, last] = directory_paths.equal_range(path);
+        forget(first, last);
+
+        // '0' sorts right after '/'
+        scratch_key.assign(path).append("/");
+        auto below = directory_paths.lower_bound(scratch_key);
+        scratch_key.back() = '0';
+        forget(below, directory_paths.lower_bound(scratch_key));
+    }
+
+    void fanotify_watcher::parse(const char* data, std::size_t size)
+    {
+        std::size_t offset = 0;
+        while (offset + FAN_EVENT_METADATA_LEN <= size)
+        {
+            fanotify_event_metadata record;
+            std::memcpy(&record, data + offset, sizeof(record));
+
+            if (record.event_len < FAN_EVENT_METADATA_LEN || offset + record.event_len > size)
+                break;
+
+            const char* info = data + offset + record.metadata_len;
+            const char* end = data + offset + record.event_len;
+            offset += record.event_len;
+
+            if (record.mask & FAN_Q_OVERFLOW)
+            {
+                record_overflow();
+                continue;
+            }
+
+            // the directory is the only thing looked for, events without
+            // one do not concern the entries of a watched directory
+            fanotify_event_info_header header;
+            while (info + sizeof(header) <= end)
+            {
+                std::memcpy(&header, info, sizeof(header));
+                if (header.info_type == FAN_EVENT_INFO_TYPE_DFID_NAME || header.len == 0)
+                    break;
+                info += header.len;
+            }
+
+            if (info + sizeof(fanotify_event_info_fid) + sizeof(file_handle) > end
+                || header.info_type != FAN_EVENT_INFO_TYPE_DFID_NAME)
+                continue;
+
+            __kernel_fsid_t fsid;
+            std::memcpy(&fsid, info + offsetof(fanotify_event_info_fid, fsid), sizeof(fsid));
+
+            const mount* on = find_mount(fsid);
+            if (on == nullptr)
+                continue;
+
+            const char* handle_data = info + offsetof(fanotify_event_info_fid, handle);
+            file_handle handle;
+            std::memcpy(&handle, handle_data, sizeof(handle));
+
+            const char* record_name = handle_data + sizeof(file_handle) + handle.handle_bytes;
+            if (record_name >= info + header.len)
+                continue;
+
+            uint32_t changes = 0;
+            if (record.mask & FAN_CREATE)      changes |= filesystem_event::created;
+            if (record.mask & FAN_MODIFY)      changes |= filesystem_event::modified;
+            if (record.mask & FAN_ATTRIB)      changes |= filesystem_event::attributes;
+            if (record.mask & FAN_DELETE)      changes |= filesystem_event::deleted;
+            if (record.mask & FAN_MOVED_FROM)  changes |= filesystem_event::moved_from;
+            if (record.mask & FAN_MOVED_TO)    changes |= filesystem_event::moved_to;
+
+            if (changes == 0)
+                continue;
+
+            // copied out, the records have no alignment to speak of
+            if (handle.handle_bytes > MAX_HANDLE_SZ)
+                continue;
+
+            alignas(file_handle) unsigned char handle_copy[sizeof(file_handle) + MAX_HANDLE_SZ];
+            std::memcpy(handle_copy, handle_data, sizeof(file_handle) + handle.handle_bytes);
+
+            const cached_directory* directory = resolve_directory(*on, reinterpret_cast<file_handle*>(handle_copy));
+            if (directory == nullptr)
+                continue;
+
+            const bool is_directory = record.mask & FAN_ONDIR;
+
+            // only directories themselves matter outside the watched trees
+            if (not directory->watched && not is_directory)
+                continue;
+
+            std::string_view name_view(record_name, strnlen(record_name, (info + header.len) - record_name));
+            if (name_view == ".")
+                name_view = {};
+
+            const std::string_view directory_view(directory->path);
+
+            // the cache may drop the path before the events are handled
+            if (directory->watched)
+            {
+                const char* directory_path = names.intern(directory_view);
+                record_change(directory_path, names.intern(name_view), changes, is_directory);
+            }
+
+            if (is_directory)
+            {
+                // a watched directory itself is reported by its parent
+                for (const root& r : roots)
+                {
+                    const std::size_t slash = r.path.rfind('/');
+                    if (slash == std::string_view::npos || r.path.substr(slash + 1) != name_view)
+                        continue;
+
+                    if (directory_view == r.path.substr(0, std::max<std::size_t>(slash, 1)))
+                        record_change(r.path.data(), "", changes, true);
+                }
+
+                if (record.mask & (FAN_DELETE | FAN_MOVED_FROM))
+                {
+                    scratch_path.assign(directory_view);
+                    if (scratch_path != "/")
+                        scratch_path.append("/");
+                    scratch_path.append(name_view);
+
+                    forget_directories(scratch_path);
+                }
+            }
+        }
+    }
+
 }
+/*
+    Copyright (c) 2021 Jari Ronkainen
+
+    This software is provided 'as-is', without any express or implied warranty.
+    In no event will the authors be held liable for any damages arising from the
+    use of this software.
+
+    Permission is granted to anyone to use this software for any purpose, including
+    commercial applications, and to alter it and redistribute it freely, subject to
+    the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not claim
+       that you wrote the original software. If you use this software in a product,
+       an acknowledgment in the product documentation would be appreciated but is
+       not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+       misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source distribution.
+*/
@@ -1,8 +1,232 @@
+/*!
+ *  \file       network.cpp
+ *  \brief      network sources for linux
+ *  \author     Jari Ronkainen
+ *  \version    0.2
+ *
+ *  Listening sockets are drained with accept4 on every readiness, so a
+ *  burst of connections costs one wakeup instead of one per connection.
+ *  Connected sockets are read into buffers from the pool of the queue.
+ */
 #include <cppevents/network.hpp>
 
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
 #include <unistd.h>
 #include <fcntl.h>
 
 namespace cppevents
 {
+    namespace
+    {
+        uint16_t port_of(const sockaddr_storage& address) noexcept
+        {
+            if (address.ss_family == AF_INET)
+                return ntohs(reinterpret_cast<const sockaddr_in&>(address).sin_port);
+            if (address.ss_family == AF_INET6)
+                return ntohs(reinterpret_cast<const sockaddr_in6&>(address).sin6_port);
+            return 0;
+        }
+
+        // descriptor kept open for when the process runs out of them.  a
+        // listener with connections it cannot accept stays readable, so
+        // they are accepted into the room this one leaves and closed
+        std::mutex spare_lock;
+        int spare_fd = -1;
+
+        void reserve_spare_fd() noexcept
+        {
+            std::lock_guard<std::mutex> lock(spare_lock);
+            if (spare_fd == -1)
+                spare_fd = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+        }
+
+        /**
+         * Close every connection pending on a listener
+         *
+         * Stops early if the spare descriptor is taken by someone else in
+         * the meantime, the rest is tried again on the next wakeup.
+         */
+        void drop_connections(native_source_type fd) noexcept
+        {
+            std::lock_guard<std::mutex> lock(spare_lock);
+
+            if (spare_fd == -1)
+                spare_fd = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+
+            while (spare_fd != -1)
+            {
+                ::close(spare_fd);
+
+                int sock = ::accept4(fd, nullptr, nullptr, SOCK_CLOEXEC);
+                const int error = errno;
+
+                if (sock != -1)
+                    ::close(sock);
+
+                spare_fd = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+
+                if (sock == -1 && error != ECONNABORTED && error != EINTR)
+                    return;
+            }
+        }
+
+        void report_accept_failure(native_source_type fd, int error, event_buffer& events)
+        {
+            network_event ev;
+            ev.type = network_event::accept_failed;
+            ev.sock_handle = fd;
+            ev.error = error;
+
+            events.push_back(std::move(ev));
+        }
+
+        /**
+         * Accept every pending connection
+         *
+         * The listener is level triggered, so stopping early on an error
+         * only delays the rest to the next wakeup.
+         */
+        void accept_connections(native_source_type fd, event_buffer& events)
+        {
+            for (;;)
+            {
+                network_event ev;
+                socklen_t length = sizeof(ev.peer_address);
+
+                int sock = ::accept4(fd, reinterpret_cast<sockaddr*>(&ev.peer_address), &length, SOCK_NONBLOCK | SOCK_CLOEXEC);
+                if (sock == -1)
+                {
+                    // gone before it was accepted, or interrupted
+                    if (errno == ECONNABORTED || errno == EINTR)
+                        continue;
+
+                    if (errno == EAGAIN || errno == EWOULDBLOCK)
+                        return;
+
+                    const int error = errno;
+                    if (error == EMFILE || error == ENFILE)
+                        drop_connections(fd);
+
+                    report_accept_failure(fd, error, events);
+                    return;
+                }
+
+                ev.type = network_event::new_connection;
+                ev.sock_handle = sock;
+                ev.peer_port = port_of(ev.peer_address);
+
+                events.push_back(std::move(ev));
+            }
+        }
+
+        /**
+         * Read what has arrived into buffers of the queue
+         *
+         * Level triggered and bounded, whatever is left is read on the
+         * next wakeup so that one busy socket does not hold up the rest.
+         */
+        void receive_data(native_source_type fd, event_buffer& events)
+        {
+            constexpr int max_reads = 4;
+
+            for (int reads = 0; reads < max_reads; )
+            {
+                buffer_lease buffer = buffer_lease::acquire();
+
+                ssize_t bytes = ::read(fd, buffer.data(), buffer_lease::capacity);
+                if (bytes == -1 && errno == EINTR)
+                    continue;
+
+                if (bytes == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                    return;
+
+                network_event ev;
+                ev.sock_handle = fd;
+
+                if (bytes <= 0)
+                {
+                    ev.type = network_event::connection_closed;
+                    events.push_back(std::move(ev));
+                    return;
+                }
+
+                ev.type = network_event::data_received;
+                ev.data = std::span<const std::byte>(buffer.data(), static_cast<std::size_t>(bytes));
+                ev.buffer = std::move(buffer);
+                events.push_back(std::move(ev));
+
+                // drained, no need for another read to find out
+                if (static_cast<std::size_t>(bytes) < buffer_lease::capacity)
+                    return;
+
+                reads++;
+            }
+        }
+    }
+
+    std::string network_event::peer_name() const
+    {
+        char text[INET6_ADDRSTRLEN] = {};
+
+        if (peer_address.ss_family == AF_INET)
+            inet_ntop(AF_INET, &reinterpret_cast<const sockaddr_in&>(peer_address).sin_addr, text, sizeof(text));
+        else if (peer_address.ss_family == AF_INET6)
+            inet_ntop(AF_INET6, &reinterpret_cast<const sockaddr_in6&>(peer_address).sin6_addr, text, sizeof(text));
+
+        return text;
+    }
+
+    template <> error_code add_source<socket_listener, int>(
+        int listener,
+        event_queue& queue)
+    {
+        // accepting until EAGAIN needs it
+        int flags = ::fcntl(listener, F_GETFL);
+        if (flags == -1 || ::fcntl(listener, F_SETFL, flags | O_NONBLOCK) == -1)
+            return error_code::system_error;
+
+        // taken while there are descriptors to spare
+        reserve_spare_fd();
+
+        return queue.add_native_source(listener, &accept_connections, nullptr, trigger_mode::exclusive);
+    }
+
+    template <> error_code add_source<socket_io_event, int>(
+        int sock,
+        event_queue& queue)
+    {
+        int flags = ::fcntl(sock, F_GETFL);
+        if (flags == -1 || ::fcntl(sock, F_SETFL, flags | O_NONBLOCK) == -1)
+            return error_code::system_error;
+
+        return queue.add_native_source(sock, &receive_data, nullptr, trigger_mode::level);
+    }
 }
+/*
+    Copyright (c) 2021 Jari Ronkainen
+
+    This software is provided 'as-is', without any express or implied warranty.
+    In no event will the authors be held liable for any damages arising from the
+    use of this software.
+
+    Permission is granted to anyone to use this software for any purpose, including
+    commercial applications, and to alter it and redistribute it freely, subject to
+    the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not claim
+       that you wrote the original software. If you use this software in a product,
+       an acknowledgment in the product documentation would be appreciated but is
+       not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+       misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source distribution.
+*/
@@ -4,146 +4,175 @@
  *  \author     Jari Ronkainen
  *  \version    0.9
  *
- *  Implementations for timerfd and signalfd to libcppevents
- *
- *  \todo timerfd
+ *  Implementations for timerfd and signalfd to libcppevents,
+ *  timers are run by the timer wheel of the queue and signals are
+ *  read from a signalfd of the queue
  */
 #include <cppevents/timer.hpp>
 #include <cppevents/signal.hpp>
 
+#include "signal_source.hpp"
+
 #include <sys/signalfd.h>
-#include <sys/timerfd.h>
 #include <sys/signal.h>
 
 #include <unistd.h>
 
-#include <unordered_set>
+#include <iterator>
+#include <utility>
 
 namespace cppevents
 {
-    static int signal_fd = -1;
-
-    raw_event create_signal_event(int fd)
+    namespace detail
     {
-        event::signal ev;
+        signal_source::signal_source() noexcept
+        {
+            sigemptyset(&mask);
+            sigemptyset(&blocked_here);
+        }
 
-        struct signalfd_siginfo siginfo;
-        ssize_t bytes = read(fd, &siginfo, sizeof(struct signalfd_siginfo));
+        signal_source::~signal_source()
+        {
+            if (signal_fd != -1)
+                ::close(signal_fd);
 
-        if (bytes != sizeof(struct signalfd_siginfo))
-            return event::signal{};
+            pthread_sigmask(SIG_UNBLOCK, &blocked_here, nullptr);
+        }
 
-        ev.signal_no = siginfo.ssi_signo;
-        ev.sender_pid = siginfo.ssi_pid;
-        ev.sender_uid = siginfo.ssi_uid;
-        ev.trap_no = siginfo.ssi_trapno;
-        ev.status = siginfo.ssi_status;
+        /**
+         * Add a signal to the signalfd, opening it on the first one
+         *
+         * \return  error_code::already_exists if the signal was added already
+         */
+        error_code signal_source::add(int signal, bool& created)
+        {
+            created = false;
 
-        return ev;
-    }
+            if (sigismember(&mask, signal) == 1)
+                return error_code::already_exists;
 
-    void delete_signal_event(int fd)
-    {
-        (void) fd;
+            sigset_t single;
+            sigset_t old_mask;
+            sigemptyset(&single);
+            if (sigaddset(&single, signal) == -1)
+                return error_code::system_error;
 
-        // unblock everything
-        sigset_t mask;
-        sigprocmask(SIG_BLOCK, nullptr, &mask);
-        sigprocmask(SIG_UNBLOCK, &mask, nullptr);
+            // blocked from the default handling, signalfd only gets
+            // signals that are blocked
+            if (pthread_sigmask(SIG_BLOCK, &single, &old_mask) != 0)
+                return error_code::system_error;
 
-        close(signal_fd);
-        signal_fd = -1;
-    }
+            if (sigismember(&old_mask, signal) == 0)
+                sigaddset(&blocked_here, signal);
 
-    template <> error_code add_source<cppevents::event::signal, int>(
-        int signal,
-        event_queue& queue)
-    {
-        sigset_t mask;
-        sigprocmask(SIG_BLOCK, nullptr, &mask);
+            sigaddset(&mask, signal);
 
-        if (sigismember(&mask, signal))
-            return error_code::already_exists;
+            if (signal_fd != -1)
+            {
+                if (signalfd(signal_fd, &mask, 0) == -1)
+                {
+                    remove(signal);
+                    return error_code::system_error;
+                }
+                return error_code::success;
+            }
 
-        sigaddset(&mask, signal);
+            signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+            if (signal_fd == -1)
+            {
+                remove(signal);
+                return error_code::system_error;
+            }
 
-        // block the signal from the default handling
-        if (sigprocmask(SIG_BLOCK, &mask, nullptr) == -1)
-            return error_code::system_error;
+            created = true;
+            return error_code::success;
+        }
 
-        if (signal_fd != -1)
+        /**
+         * Stop reading a signal, and unblock it if it was blocked by add
+         *
+         * \return  false if the signal was not added
+         */
+        bool signal_source::remove(int signal)
         {
-            if (signalfd(signal_fd, &mask, 0) == -1)
-                return error_code::system_error;
-            else
-                return error_code::success;
+            if (sigismember(&mask, signal) != 1)
+                return false;
+
+            sigdelset(&mask, signal);
+            if (signal_fd != -1)
+                signalfd(signal_fd, &mask, 0);
+
+            if (sigismember(&blocked_here, signal) == 1)
+            {
+                sigset_t single;
+                sigemptyset(&single);
+                sigaddset(&single, signal);
+                pthread_sigmask(SIG_UNBLOCK, &single, nullptr);
+                sigdelset(&blocked_here, signal);
+            }
+
+            return true;
         }
 
-        signal_fd = signalfd(signal_fd, &mask, 0);
-
-        if (signal_fd == -1)
-            return error_code::system_error;
-
-        queue.add_native_source(signal_fd, create_signal_event, delete_signal_event);
-
-        return error_code::success;
-    }
-
-    raw_event create_timer_event(int fd)
-    {
-        event::timer ev;
-
-        uint64_t exp;
-
-        read(fd, &exp, sizeof(uint64_t));
-
-        ev.expirations = exp;
-
-        return ev;
-    }
+        void signal_source::close() noexcept
+        {
+            if (signal_fd != -1)
+                ::close(std::exchange(signal_fd, -1));
+        }
 
-    void delete_timer_event(int fd)
-    {
-        close(fd);
+        /**
+         * Read every pending signal, the signalfd hands out as many
+         * records as fit in the buffer per read
+         */
+        void signal_source::read(native_source_type fd, event_buffer& events)
+        {
+            signalfd_siginfo records[64];
+
+            for (;;)
+            {
+                ssize_t bytes = ::read(fd, records, sizeof(records));
+                if (bytes <= 0)
+                    return;
+
+                const std::size_t count = static_cast<std::size_t>(bytes) / sizeof(signalfd_siginfo);
+
+                for (std::size_t i = 0; i < count; ++i)
+                {
+                    event::signal ev;
+                    ev.signal_no = records[i].ssi_signo;
+                    ev.sender_pid = records[i].ssi_pid;
+                    ev.sender_uid = records[i].ssi_uid;
+                    ev.trap_no = records[i].ssi_trapno;
+                    ev.status = records[i].ssi_status;
+
+                    events.push_back(ev);
+                }
+
+                if (count < std::size(records))
+                    return;
+            }
+        }
     }
 
-    void do_stuff(timer& timer_conf, event_queue& queue)
+    template <> error_code add_source<cppevents::event::signal, int>(
+        int signal,
+        event_queue& queue)
     {
-        itimerspec tp{};
-
-        std::cout << "assign timer: " << timer_conf.seconds << "s\n";
-        std::cout << "assign timer: " << timer_conf.nanoseconds << "ns\n";
-
-        tp.it_interval.tv_nsec = timer_conf.nanoseconds;
-        tp.it_interval.tv_sec = timer_conf.seconds;
-
-        tp.it_value.tv_nsec = timer_conf.nanoseconds;
-        tp.it_value.tv_sec = timer_conf.seconds; // immediately start the timer
-
-        int timerfd = timerfd_create(CLOCK_MONOTONIC, 0);
-
-        int error = timerfd_settime(timerfd, 0, &tp, NULL);
-
-        if (error)
-            std::cout << "timerfd_settime: " << error << " / " << errno << "\n";;
-
-        queue.add_native_source(timerfd, create_timer_event, delete_timer_event);
+        return queue.add_signal(signal);
     }
 
     template <> error_code add_source<cppevents::source::unspecified, timer>(
         timer& timer_conf,
         event_queue& queue)
     {
-        do_stuff(timer_conf, queue);
-        return error_code::success;
+        return queue.add_timer(timer_conf);
     }
 
     template <> error_code add_source<cppevents::source::unspecified, timer>(
         timer&& timer_conf,
         event_queue& queue)
     {
-        do_stuff(timer_conf, queue);
-        return error_code::success;
+        return queue.add_timer(timer_conf);
     }
 }
 /*
@@ -0,0 +1,366 @@
+/*!
+ *  \file       queue_implementation.hpp
+ *  \brief      the part of event_queue shared by every polling system
+ *  \author     Jari Ronkainen
+ *  \version    0.1
+ */
+#ifndef LIBCPPEVENTS_QUEUE_IMPLEMENTATION_HPP
+#define LIBCPPEVENTS_QUEUE_IMPLEMENTATION_HPP
+
+#include <cppevents/event_queue.hpp>
+
+#include "signal_source.hpp"
+#include "timer_wheel.hpp"
+
+#include <atomic>
+#include <deque>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace cppevents
+{
+    /*!
+     *  \brief  Event queue without the polling system
+     *
+     *  Handlers, posted events, the inbox for other threads, timers,
+     *  signals, coroutines and the table of native sources work the same
+     *  on every backend.  A backend derives from this, puts descriptors
+     *  in its kernel interface through the watch functions and runs the
+     *  loop in wait(), handing ready sources to dispatch_source().
+     */
+    class event_queue::implementation
+    {
+        public:
+            implementation();
+            virtual ~implementation();
+
+            implementation(const implementation&) = delete;
+            implementation& operator=(const implementation&) = delete;
+
+            error_code bind_event_to_func(event_details::id_type, callback_type, std::string_view, bool = false) noexcept;
+
+            virtual void wait(std::chrono::steady_clock::time_point deadline, bool block = true) noexcept = 0;
+
+            error_code add_native_source(native_source_type fd, translator_type func, destructor_type, trigger_mode);
+            error_code add_native_source(native_source_type fd, batch_translator_type func, destructor_type, trigger_mode);
+            void remove_native_source(native_source_type fd);
+
+            error_code send_event(event_details, raw_event);
+            error_code post_event(event_details, raw_event);
+
+            void execute(task_type);
+
+            queue_statistics statistics() const noexcept;
+
+            void set_batch_size(uint32_t size, uint32_t max_size) noexcept;
+
+            void set_memory_resource(std::pmr::memory_resource*) noexcept;
+
+            void await_event(event_details::id_type, detail::event_waiter&);
+            void await_deadline(detail::deadline_waiter&);
+            bool await_readable(native_source_type, detail::readiness_waiter&, error_code&);
+
+            error_code add_timer(const timer&);
+            bool cancel_timer(int timer_id);
+
+            error_code add_signal(int signal);
+            bool remove_signal(int signal);
+
+            // called while the backend is still there, a coroutine
+            // destroyed here may remove the sources it was using
+            void destroy_waiters() noexcept;
+
+        protected:
+            // abandoned by the destructor, it stays around until the
+            // events, buffers and frames allocated from it are freed
+            detail::event_pool& pool = detail::event_pool::create();
+
+            // while a thread is in wait() or poll(), the queue belongs to
+            // it and large events created there come from the pool of
+            // the queue.  the pool current before is restored afterwards
+            class running_scope
+            {
+                public:
+                    explicit running_scope(implementation& queue) noexcept;
+                    ~running_scope();
+
+                    running_scope(const running_scope&) = delete;
+                    running_scope& operator=(const running_scope&) = delete;
+
+                private:
+                    detail::event_pool* previous_pool;
+            };
+
+            // a source has either kind of translator, or none when only
+            // coroutines await its readiness
+            struct translator_entry
+            {
+                translator_type single = nullptr;
+                batch_translator_type batch = nullptr;
+            };
+
+            // coroutine awaiting readiness of a source without a
+            // translator.  readiness watches are edge triggered and stay
+            // registered, a readable edge with nobody waiting is
+            // remembered for the next await
+            struct readiness_watch
+            {
+                detail::readiness_waiter* waiter = nullptr;
+                bool ready = false;
+            };
+
+            // everything known about a registered descriptor, in a table
+            // indexed by the descriptor.  the backends tag readiness with
+            // the descriptor and generation, so a ready source is found
+            // without hashing, and readiness of one removed earlier in
+            // the same batch is not taken for a new one on the same fd
+            struct source_record
+            {
+                translator_entry translator;
+                destructor_type destructor = nullptr;
+
+                // zero while nothing is registered
+                uint32_t generation = 0;
+                trigger_mode mode = trigger_mode::level;
+
+                readiness_watch watch;
+            };
+
+            // put a source in the kernel interface, and take it out.
+            // watch_source returns false with errno set when refused
+            virtual bool watch_source(native_source_type fd, const source_record& source) noexcept = 0;
+            virtual void unwatch_source(native_source_type fd, const source_record& source) noexcept = 0;
+
+            // a descriptor is added while a record of it is still there.
+            // returns false with errno set to EEXIST if the record is of
+            // the same file and still in use, otherwise the backend lets
+            // go of whatever it had for the stale one
+            virtual bool release_stale_source(native_source_type fd, const source_record& stale) noexcept = 0;
+
+            // readiness of the eventfd and the timerfd, reported with
+            // notify_data and timer_data
+            virtual bool watch_internal(int fd, uint64_t data) noexcept = 0;
+
+            static constexpr uint64_t notify_data = ~uint64_t(0);
+            static constexpr uint64_t timer_data = ~uint64_t(1);
+
+            // generations never reach the upper half of the values above
+            static constexpr uint64_t source_data(native_source_type fd, uint32_t generation) noexcept {
+                return (uint64_t(generation) << 32) | uint32_t(fd);
+            }
+
+            static constexpr native_source_type source_fd(uint64_t data) noexcept {
+                return static_cast<native_source_type>(data & 0xffffffff);
+            }
+
+            static constexpr uint32_t source_generation(uint64_t data) noexcept {
+                return static_cast<uint32_t>(data >> 32);
+            }
+
+            source_record* find_source(native_source_type fd) noexcept
+            {
+                if (fd < 0 || static_cast<std::size_t>(fd) >= sources.size() || sources[fd].generation == 0)
+                    return nullptr;
+                return &sources[fd];
+            }
+
+            //! Whether the source seen with a generation is still registered
+            bool is_registered(native_source_type fd, uint32_t generation) noexcept
+            {
+                const source_record* source = find_source(fd);
+                return source != nullptr && source->generation == generation;
+            }
+
+            // every registered source, for a backend starting over with
+            // a new kernel interface
+            template <typename Func>
+            void for_each_source(Func&& func)
+            {
+                for (std::size_t fd = 0; fd < sources.size(); ++fd)
+                    if (sources[fd].generation != 0)
+                        func(static_cast<native_source_type>(fd), sources[fd]);
+            }
+
+            /*!
+             *  \brief  Handle readiness of a source tagged with source_data
+             *
+             *  \return false if nothing was dispatched or resumed
+             */
+            bool dispatch_source(uint64_t data);
+
+            inline void call(raw_event& ev) {
+                if (waiting_coroutines != 0)
+                    resume_event_waiters(ev);
+                if (callback_type* callback = event_mappings.find(ev.type()); callback != nullptr && *callback) {
+                    (*callback)(ev);
+                }
+                // also true when an offloaded handler took the event
+                if (ev.group() == 0)
+                    return;
+                if (callback_type* callback = group_mappings.find(ev.group()); callback != nullptr && *callback) {
+                    (*callback)(ev);
+                }
+            }
+
+            bool dispatch_posted_events();
+            int dispatch_remote_events();
+            int expire_timers();
+            int resume_expired_deadlines();
+
+            // how long the next poll may block, the time left of the wait
+            // cut short by the nearest deadline.  negative for no limit
+            std::chrono::nanoseconds poll_timeout(std::chrono::steady_clock::time_point deadline) const noexcept;
+
+            // if max_batch_size is larger than min_batch_size, the batch
+            // doubles every time it comes back full and halves when the
+            // queue goes quiet.  the backend keeps its ready list at least
+            // batch_size long
+            void adapt_batch_size(int event_count) noexcept;
+
+            uint32_t batch_size = 16;
+            uint32_t min_batch_size = 16;
+            uint32_t max_batch_size = 16;
+
+            std::atomic<uint64_t> poll_calls = 0;
+
+            // set when send_event delivers something while we are waiting,
+            // e.g. from a translator that forwards events by itself
+            bool events_sent = false;
+
+            int notify_fd = -1;
+            int timer_fd = -1;
+
+        private:
+            // flat open addressing table from event/group id to callback.
+            // ids are hashes already, so the low bits pick the slot and a
+            // lookup is usually a single load and compare.  the callbacks
+            // themselves stay put in a deque, a handler may bind more
+            // types while it runs and the slots move when they grow
+            struct handler_table
+            {
+                struct slot
+                {
+                    event_details::id_type id = 0;
+                    std::string_view name;
+                    callback_type* callback = nullptr;
+                };
+
+                std::vector<slot> slots;
+                std::deque<callback_type> callbacks;
+
+                callback_type* find(event_details::id_type id) noexcept
+                {
+                    if (slots.empty())
+                        return nullptr;
+
+                    const std::size_t mask = slots.size() - 1;
+                    for (std::size_t i = id & mask;; i = (i + 1) & mask)
+                    {
+                        if (slots[i].id == id)
+                            return slots[i].callback;
+                        if (slots[i].id == 0)
+                            return nullptr;
+                    }
+                }
+
+                error_code insert(event_details::id_type, std::string_view, callback_type);
+                slot& find_slot(event_details::id_type id) noexcept;
+            };
+
+            handler_table event_mappings;
+            handler_table group_mappings;
+
+            error_code register_native_source(native_source_type fd, translator_entry, destructor_type, trigger_mode);
+            source_record& claim_source(native_source_type fd, trigger_mode mode);
+            int translate_batch(batch_translator_type func, native_source_type fd);
+
+            std::vector<source_record> sources;
+            uint32_t next_generation = 1;
+
+            // output buffer for batch translators, reused between calls
+            event_buffer translated_events;
+
+            // coroutines waiting for an event type and for a point in time
+            void resume_event_waiters(raw_event& ev);
+            int resume_readiness_waiter(readiness_watch& watch);
+
+            std::unordered_map<event_details::id_type, detail::event_waiter*> event_waiters;
+            std::size_t waiting_coroutines = 0;
+
+            // min-heap on the deadline
+            std::vector<detail::deadline_waiter*> deadlines;
+
+            // every timer of the queue shares one timerfd, armed for the
+            // earliest slot of the wheel.  it is left armed when timers
+            // go away, an early wakeup only arms it again
+            void arm_timer_fd() noexcept;
+
+            detail::timer_wheel timers;
+            detail::timer_wheel::clock::time_point timer_armed = detail::timer_wheel::clock::time_point::max();
+
+            std::atomic<uint64_t> timer_wakeups = 0;
+            std::atomic<uint64_t> timer_wakeups_saved = 0;
+
+            detail::signal_source signals;
+
+            std::atomic<uint64_t> full_batches = 0;
+
+            // events sent from other threads, multi-producer single-consumer
+            // stack that the loop thread takes as a whole and reverses
+            struct inbox_node
+            {
+                raw_event ev;
+                inbox_node* next;
+            };
+
+            bool on_queue_thread() const noexcept {
+                return std::this_thread::get_id() == queue_thread.load(std::memory_order_relaxed);
+            }
+
+            void push_remote_event(raw_event);
+
+            // functions given to execute from other threads travel
+            // through the inbox as events of this type
+            struct queued_task
+            {
+                task_type task;
+            };
+
+            std::atomic<inbox_node*> inbox = nullptr;
+            std::atomic<std::thread::id> queue_thread = std::this_thread::get_id();
+
+            std::atomic<uint64_t> remote_events = 0;
+            std::atomic<uint64_t> remote_wakeups = 0;
+
+            // events posted from the queue thread, drained by wait/poll.
+            // the two buffers are swapped on drain, so events posted by
+            // handlers wait for the next round instead of recursing
+            std::vector<raw_event> posted_events;
+            std::vector<raw_event> dispatched_events;
+    };
+}
+
+#endif
+/*
+    Copyright (c) 2021 Jari Ronkainen
+
+    This software is provided 'as-is', without any express or implied warranty.
+    In no event will the authors be held liable for any damages arising from the
+    use of this software.
+
+    Permission is granted to anyone to use this software for any purpose, including
+    commercial applications, and to alter it and redistribute it freely, subject to
+    the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not claim
+       that you wrote the original software. If you use this software in a product,
+       an acknowledgment in the product documentation would be appreciated but is
+       not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+       misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source distribution.
+*/
@@ -0,0 +1,72 @@
+/*!
+ *  \file       signal_source.hpp
+ *  \brief      signalfd owned by an event queue
+ *  \author     Jari Ronkainen
+ *  \version    0.1
+ */
+#ifndef LIBCPPEVENTS_SIGNAL_SOURCE_HPP
+#define LIBCPPEVENTS_SIGNAL_SOURCE_HPP
+
+#include <cppevents/event_queue.hpp>
+
+#include <signal.h>
+
+namespace cppevents::detail
+{
+    /*!
+     *  \brief  Signals of a queue, delivered through a signalfd
+     *
+     *  Signals are blocked in the thread adding them, and unblocked again
+     *  when removed unless they were blocked to begin with.  Every wakeup
+     *  reads all pending signals at once, one event per signal.
+     */
+    class signal_source
+    {
+        public:
+            signal_source() noexcept;
+            ~signal_source();
+
+            signal_source(const signal_source&) = delete;
+            signal_source& operator=(const signal_source&) = delete;
+
+            //! created is set when the signalfd was opened by this call
+            error_code add(int signal, bool& created);
+            bool remove(int signal);
+
+            //! Close the signalfd, e.g. when the queue could not watch it
+            void close() noexcept;
+
+            native_source_type fd() const noexcept { return signal_fd; }
+
+            //! Batch translator for the signalfd
+            static void read(native_source_type, event_buffer&);
+
+        private:
+            sigset_t mask;
+            sigset_t blocked_here;
+            int signal_fd = -1;
+    };
+}
+
+#endif
+/*
+    Copyright (c) 2021 Jari Ronkainen
+
+    This software is provided 'as-is', without any express or implied warranty.
+    In no event will the authors be held liable for any damages arising from the
+    use of this software.
+
+    Permission is granted to anyone to use this software for any purpose, including
+    commercial applications, and to alter it and redistribute it freely, subject to
+    the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not claim
+       that you wrote the original software. If you use this software in a product,
+       an acknowledgment in the product documentation would be appreciated but is
+       not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+       misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source distribution.
+*/
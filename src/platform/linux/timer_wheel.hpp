@@ -0,0 +1,489 @@
+/*!
+ *  \file       timer_wheel.hpp
+ *  \brief      hierarchical timing wheel shared by the queue backends
+ *  \author     Jari Ronkainen
+ *  \version    0.1
+ */
+#ifndef LIBCPPEVENTS_TIMER_WHEEL_HPP
+#define LIBCPPEVENTS_TIMER_WHEEL_HPP
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+namespace cppevents::detail
+{
+    /*!
+     *  \brief  Timers of a queue, hashed into wheels by expiry
+     *
+     *  Four wheels of 256 slots each cover 2^32 ticks of a millisecond,
+     *  timers further out wait in an overflow list.  A timer goes to the
+     *  wheel whose slots are just wide enough for its distance, and is
+     *  cascaded down as the time reaches its slot.  Every timer is linked
+     *  in exactly one slot, so scheduling, cancelling and rescheduling are
+     *  O(1), and advancing skips the blocks of time with nothing in them.
+     *
+     *  A timer with slack may fire anywhere between its expiry and the
+     *  slack after it.  It is moved to the coarsest aligned tick in that
+     *  window, so timers with overlapping windows tend to meet on the
+     *  same tick.  Those that still land apart are caught by the tick
+     *  firing first: it also fires every timer whose window it falls in.
+     */
+    class timer_wheel
+    {
+        public:
+            using clock = std::chrono::steady_clock;
+            using tick_type = uint64_t;
+
+            static constexpr std::chrono::milliseconds tick{1};
+
+            struct expiry
+            {
+                int timer_id;
+                uint64_t expirations;
+                bool last_tick;
+            };
+
+            timer_wheel() noexcept : epoch{clock::now()} {}
+
+            timer_wheel(const timer_wheel&) = delete;
+            timer_wheel& operator=(const timer_wheel&) = delete;
+
+            std::size_t size() const noexcept { return timers.size(); }
+
+            /*!
+             *  \brief  Add a timer, or move one with the same id
+             *
+             *  \param  repeats number of expirations, -1 for no end
+             *  \param  slack   how much later than asked the timer may fire
+             */
+            void schedule(int id, clock::duration first, clock::duration interval, int repeats,
+                          clock::duration slack = clock::duration::zero())
+            {
+                const clock::time_point now = clock::now();
+
+                if (timers.empty())
+                    current = tick_of(now);
+
+                entry& timer = timers[id];
+                unlink(timer);
+
+                timer.id = id;
+                timer.due = std::max(ticks_until(now + first), current);
+                timer.interval = std::max<tick_type>(ticks_in(interval), 1);
+                timer.slack = slack > clock::duration::zero() ? ticks_in(slack) : 0;
+                timer.remaining = repeats == 0 ? 1 : repeats;
+                timer.expires = align(timer.due, timer.slack);
+
+                if (timer.slack > 0)
+                    link_slack(timer);
+                else
+                    unlink_slack(timer);
+
+                insert(timer);
+            }
+
+            //! \return false if there was no such timer
+            bool cancel(int id)
+            {
+                auto it = timers.find(id);
+                if (it == timers.end())
+                    return false;
+
+                unlink(it->second);
+                unlink_slack(it->second);
+                timers.erase(it);
+                return true;
+            }
+
+            /*!
+             *  \brief  Fire everything due by now
+             *
+             *  fire(expiry) is called once per due timer.  It may schedule
+             *  and cancel timers, including the one being fired.
+             *
+             *  \return number of timers fired
+             */
+            template <typename Func>
+            int advance(clock::time_point now, Func&& fire)
+            {
+                const tick_type target = tick_of(now);
+
+                int fired = 0;
+                while (current <= target && not timers.empty())
+                {
+                    cascade();
+
+                    if (counts[0] == 0)
+                    {
+                        // nothing on the finest wheel, jump to the next
+                        // slot boundary of the first wheel with timers
+                        current = std::min(next_boundary(), target + 1);
+                        continue;
+                    }
+
+                    fired += expire_slot(target, fire);
+                    current++;
+                }
+
+                if (timers.empty())
+                    current = target + 1;
+
+                return fired;
+            }
+
+            //! Expiries that fired on the tick of another thanks to slack
+            uint64_t coalesced() const noexcept { return coalesced_expiries; }
+
+            /*!
+             *  \brief  When the wheel needs advancing next
+             *
+             *  \return nothing if empty, time_point::max() if no timer
+             *          was found on the wheels
+             */
+            std::optional<clock::time_point> next_wakeup() const noexcept
+            {
+                if (timers.empty())
+                    return std::nullopt;
+
+                constexpr tick_type none = ~tick_type(0);
+                tick_type wake = none;
+
+                for (unsigned level = 0; level < levels; ++level)
+                {
+                    if (counts[level] == 0)
+                        continue;
+
+                    const unsigned shift = level * level_bits;
+                    const tick_type block = current >> shift;
+
+                    // slots of the coarser wheels are due when their block
+                    // starts.  inside a block, the slot of the block holds
+                    // the timers a whole turn of the wheel away
+                    const unsigned first = at_boundary(shift) ? 0 : 1;
+
+                    for (unsigned i = first; i < first + slots; ++i)
+                    {
+                        if (wheel[level][(block + i) & slot_mask] != nullptr)
+                        {
+                            wake = std::min(wake, (block + i) << shift);
+                            break;
+                        }
+                    }
+                }
+
+                if (overflow != nullptr)
+                    wake = std::min(wake, at_boundary(levels * level_bits) ? current : next_multiple(current, levels * level_bits));
+
+                if (wake == none)
+                    return clock::time_point::max();
+
+                return epoch + std::chrono::duration_cast<clock::duration>(tick * std::max(wake, current));
+            }
+
+        private:
+            static constexpr unsigned level_bits = 8;
+            static constexpr unsigned slots = 1u << level_bits;
+            static constexpr tick_type slot_mask = slots - 1;
+            static constexpr unsigned levels = 4;
+
+            struct entry
+            {
+                int id = 0;
+                // tick asked for, and the one picked within the slack
+                tick_type due = 0;
+                tick_type expires = 0;
+                tick_type interval = 1;
+                tick_type slack = 0;
+                int remaining = -1;
+
+                entry* next = nullptr;
+                entry** prev = nullptr;
+                unsigned level = levels;
+
+                // in slack_timers while the slack is not zero
+                entry* slack_next = nullptr;
+                entry** slack_prev = nullptr;
+            };
+
+            tick_type tick_of(clock::time_point time) const noexcept
+            {
+                return static_cast<tick_type>(std::chrono::duration_cast<std::chrono::milliseconds>(time - epoch).count());
+            }
+
+            // rounded up, a timer never fires early
+            tick_type ticks_until(clock::time_point time) const noexcept
+            {
+                return static_cast<tick_type>(std::chrono::ceil<std::chrono::milliseconds>(time - epoch).count());
+            }
+
+            static tick_type ticks_in(clock::duration duration) noexcept
+            {
+                return static_cast<tick_type>(std::chrono::ceil<std::chrono::milliseconds>(duration).count());
+            }
+
+            // the tick in [due, due + slack] with the most trailing zeroes
+            static tick_type align(tick_type due, tick_type slack) noexcept
+            {
+                const tick_type limit = due + slack;
+                const tick_type differing = due ^ limit;
+                if (differing == 0)
+                    return due;
+
+                const tick_type mask = (tick_type(1) << (std::bit_width(differing) - 1)) - 1;
+                return limit & ~mask;
+            }
+
+            bool at_boundary(unsigned bits) const noexcept
+            {
+                return (current & ((tick_type(1) << bits) - 1)) == 0;
+            }
+
+            static tick_type next_multiple(tick_type value, unsigned bits) noexcept
+            {
+                return ((value >> bits) + 1) << bits;
+            }
+
+            tick_type next_boundary() const noexcept
+            {
+                unsigned level = 1;
+                while (level < levels && counts[level] == 0)
+                    level++;
+
+                return next_multiple(current, level * level_bits);
+            }
+
+            static void link(entry*& head, entry& timer) noexcept
+            {
+                timer.next = head;
+                timer.prev = &head;
+                if (head != nullptr)
+                    head->prev = &timer.next;
+                head = &timer;
+            }
+
+            void unlink(entry& timer) noexcept
+            {
+                if (timer.prev == nullptr)
+                    return;
+
+                *timer.prev = timer.next;
+                if (timer.next != nullptr)
+                    timer.next->prev = timer.prev;
+
+                if (timer.level < levels)
+                    counts[timer.level]--;
+
+                timer.next = nullptr;
+                timer.prev = nullptr;
+                timer.level = levels;
+            }
+
+            void link_slack(entry& timer) noexcept
+            {
+                if (timer.slack_prev != nullptr)
+                    return;
+
+                timer.slack_next = slack_timers;
+                timer.slack_prev = &slack_timers;
+                if (slack_timers != nullptr)
+                    slack_timers->slack_prev = &timer.slack_next;
+                slack_timers = &timer;
+            }
+
+            void unlink_slack(entry& timer) noexcept
+            {
+                if (timer.slack_prev == nullptr)
+                    return;
+
+                *timer.slack_prev = timer.slack_next;
+                if (timer.slack_next != nullptr)
+                    timer.slack_next->slack_prev = timer.slack_prev;
+
+                timer.slack_next = nullptr;
+                timer.slack_prev = nullptr;
+            }
+
+            void insert(entry& timer) noexcept
+            {
+                const tick_type delta = timer.expires > current ? timer.expires - current : 0;
+                const tick_type expires = std::max(timer.expires, current);
+
+                for (unsigned level = 0; level < levels; ++level)
+                {
+                    if (delta < (tick_type(1) << ((level + 1) * level_bits)))
+                    {
+                        timer.level = level;
+                        counts[level]++;
+                        link(wheel[level][(expires >> (level * level_bits)) & slot_mask], timer);
+                        return;
+                    }
+                }
+
+                link(overflow, timer);
+            }
+
+            // move the timers of the slots whose block starts now down
+            // to the finer wheels, coarsest first
+            void cascade() noexcept
+            {
+                if (not at_boundary(level_bits))
+                    return;
+
+                if (at_boundary(levels * level_bits))
+                    reinsert(overflow);
+
+                for (unsigned level = levels - 1; level > 0; --level)
+                {
+                    const unsigned shift = level * level_bits;
+                    if (at_boundary(shift))
+                        reinsert(wheel[level][(current >> shift) & slot_mask]);
+                }
+            }
+
+            void reinsert(entry*& head) noexcept
+            {
+                entry* timer = head;
+                head = nullptr;
+
+                while (timer != nullptr)
+                {
+                    entry* next = timer->next;
+                    if (timer->level < levels)
+                        counts[timer->level]--;
+                    timer->prev = nullptr;
+                    timer->next = nullptr;
+                    timer->level = levels;
+                    insert(*timer);
+                    timer = next;
+                }
+            }
+
+            template <typename Func>
+            int expire_slot(tick_type target, Func& fire)
+            {
+                // taken off the wheel first, handlers may touch any timer
+                entry* due = nullptr;
+                reinsert_into(due, wheel[0][current & slot_mask]);
+
+                // aligned ticks of overlapping windows may still differ,
+                // e.g. [5, 6] and [6, 7] go to 6 and 7
+                for (entry* timer = due != nullptr ? slack_timers : nullptr; timer != nullptr; timer = timer->slack_next)
+                {
+                    if (timer->due <= current && timer->expires > current)
+                    {
+                        unlink(*timer);
+                        link(due, *timer);
+                    }
+                }
+
+                count_coalesced(due);
+
+                int fired = 0;
+                while (due != nullptr)
+                {
+                    entry& timer = *due;
+                    unlink(timer);
+
+                    expiry ev{timer.id, 1, false};
+
+                    // a late wakeup counts the periods missed, like timerfd
+                    if (target > timer.due)
+                        ev.expirations += (target - timer.due) / timer.interval;
+
+                    if (timer.remaining > 0)
+                    {
+                        ev.expirations = std::min<uint64_t>(ev.expirations, timer.remaining);
+                        timer.remaining -= static_cast<int>(ev.expirations);
+                        ev.last_tick = timer.remaining == 0;
+                    }
+
+                    if (ev.last_tick)
+                    {
+                        unlink_slack(timer);
+                        timers.erase(timer.id);
+                    }
+                    else
+                    {
+                        // periods are kept on the ticks asked for, the
+                        // slack does not accumulate
+                        timer.due += ev.expirations * timer.interval;
+                        timer.expires = align(timer.due, timer.slack);
+                        insert(timer);
+                    }
+
+                    fire(ev);
+                    fired++;
+                }
+
+                return fired;
+            }
+
+            // every tick asked for beyond the first one shares this wakeup
+            void count_coalesced(const entry* list)
+            {
+                if (list == nullptr || list->next == nullptr)
+                    return;
+
+                due_ticks.clear();
+                for (; list != nullptr; list = list->next)
+                    due_ticks.push_back(list->due);
+
+                std::sort(due_ticks.begin(), due_ticks.end());
+                coalesced_expiries += std::unique(due_ticks.begin(), due_ticks.end()) - due_ticks.begin() - 1;
+            }
+
+            // moves a whole slot to a list of its own
+            void reinsert_into(entry*& list, entry*& head) noexcept
+            {
+                while (head != nullptr)
+                {
+                    entry& timer = *head;
+                    unlink(timer);
+                    link(list, timer);
+                }
+            }
+
+            std::unordered_map<int, entry> timers;
+
+            entry* wheel[levels][slots] = {};
+            entry* overflow = nullptr;
+            std::size_t counts[levels] = {};
+
+            entry* slack_timers = nullptr;
+
+            // next tick to be processed
+            tick_type current = 0;
+            clock::time_point epoch;
+
+            std::vector<tick_type> due_ticks;
+            uint64_t coalesced_expiries = 0;
+    };
+}
+
+#endif
+/*
+    Copyright (c) 2021 Jari Ronkainen
+
+    This software is provided 'as-is', without any express or implied warranty.
+    In no event will the authors be held liable for any damages arising from the
+    use of this software.
+
+    Permission is granted to anyone to use this software for any purpose, including
+    commercial applications, and to alter it and redistribute it freely, subject to
+    the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not claim
+       that you wrote the original software. If you use this software in a product,
+       an acknowledgment in the product documentation would be appreciated but is
+       not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+       misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source distribution.
+*/
@@ -0,0 +1,467 @@
+// Native sources, timers, remote events and coroutines, built once per
+// polling backend so that every backend passes the same checks
+#include <cppevents/coroutine.hpp>
+#include <cppevents/event_queue.hpp>
+#include <cppevents/timer.hpp>
+
+#include "check.hpp"
+
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/timerfd.h>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+using cppevents::error_code;
+using cppevents::event_queue;
+using cppevents::raw_event;
+using cppevents::trigger_mode;
+
+struct pipe_data
+{
+    int fd;
+    char byte;
+};
+
+struct remote_event
+{
+    int value;
+};
+
+struct test_pipe
+{
+    test_pipe()
+    {
+        int fds[2];
+        if (::pipe2(fds, O_NONBLOCK | O_CLOEXEC) == 0)
+        {
+            read_end = fds[0];
+            write_end = fds[1];
+        }
+    }
+
+    ~test_pipe()
+    {
+        if (read_end != -1)
+            ::close(read_end);
+        if (write_end != -1)
+            ::close(write_end);
+    }
+
+    void put(const std::string& data) const
+    {
+        if (::write(write_end, data.data(), data.size())) {}
+    }
+
+    int read_end = -1;
+    int write_end = -1;
+};
+
+// one byte per readiness, level triggered sources come back for the rest
+static raw_event read_byte(int fd)
+{
+    char byte;
+    if (::read(fd, &byte, 1) != 1)
+        return cppevents::empty_event{};
+
+    return pipe_data{fd, byte};
+}
+
+static void read_all(int fd, cppevents::event_buffer& events)
+{
+    char buffer[64];
+    ssize_t bytes;
+
+    while ((bytes = ::read(fd, buffer, sizeof(buffer))) > 0)
+        for (ssize_t i = 0; i < bytes; ++i)
+            events.push_back(pipe_data{fd, buffer[i]});
+}
+
+static void level_source_is_polled_again()
+{
+    event_queue queue;
+    std::string seen;
+
+    cppevents::on_event<pipe_data>([&](pipe_data& ev) { seen += ev.byte; }, queue);
+
+    test_pipe pipe;
+    CHECK(queue.add_native_source(pipe.read_end, &read_byte) == error_code::success);
+
+    pipe.put("abc");
+    for (int i = 0; i < 3; ++i)
+        queue.wait(1s);
+
+    CHECK(seen == "abc");
+
+    // and still is after the data ran out once
+    pipe.put("d");
+    queue.wait(1s);
+    CHECK(seen == "abcd");
+
+    queue.remove_native_source(pipe.read_end);
+}
+
+static void edge_source_with_batch_translator()
+{
+    event_queue queue;
+    std::string seen;
+
+    cppevents::on_event<pipe_data>([&](pipe_data& ev) { seen += ev.byte; }, queue);
+
+    test_pipe pipe;
+    CHECK(queue.add_native_source(pipe.read_end, &read_all, nullptr, trigger_mode::edge) == error_code::success);
+
+    pipe.put("xyz");
+    queue.wait(1s);
+    CHECK(seen == "xyz");
+
+    pipe.put("w");
+    queue.wait(1s);
+    CHECK(seen == "xyzw");
+
+    queue.remove_native_source(pipe.read_end);
+}
+
+static void live_source_cannot_be_added_twice()
+{
+    event_queue queue;
+    test_pipe pipe;
+
+    CHECK(queue.add_native_source(pipe.read_end, &read_byte) == error_code::success);
+    CHECK(queue.add_native_source(pipe.read_end, &read_all) != error_code::success);
+    CHECK(queue.add_native_source(-1, &read_byte) != error_code::success);
+
+    queue.remove_native_source(pipe.read_end);
+}
+
+static void removed_source_can_be_added_again()
+{
+    event_queue queue;
+    std::string seen;
+
+    cppevents::on_event<pipe_data>([&](pipe_data& ev) { seen += ev.byte; }, queue);
+
+    test_pipe pipe;
+    CHECK(queue.add_native_source(pipe.read_end, &read_byte) == error_code::success);
+    queue.remove_native_source(pipe.read_end);
+
+    pipe.put("a");
+    queue.poll();
+    CHECK(seen.empty());
+
+    CHECK(queue.add_native_source(pipe.read_end, &read_all, nullptr, trigger_mode::edge) == error_code::success);
+    queue.wait(1s);
+    CHECK(seen == "a");
+
+    queue.remove_native_source(pipe.read_end);
+}
+
+// the kernel hands the number of a closed descriptor to the next one,
+// the record left behind must not keep it from being added
+static void closed_source_can_be_added_again()
+{
+    event_queue queue;
+    std::string seen;
+
+    cppevents::on_event<pipe_data>([&](pipe_data& ev) { seen += ev.byte; }, queue);
+
+    int closed_fd;
+    {
+        test_pipe closed;
+        closed_fd = closed.read_end;
+        CHECK(queue.add_native_source(closed.read_end, &read_byte) == error_code::success);
+    }
+
+    test_pipe reused;
+    CHECK(reused.read_end == closed_fd);
+    CHECK(queue.add_native_source(reused.read_end, &read_byte) == error_code::success);
+    CHECK(queue.add_native_source(reused.read_end, &read_byte) == error_code::already_exists);
+
+    reused.put("r");
+    queue.wait(1s);
+    CHECK(seen == "r");
+
+    queue.remove_native_source(reused.read_end);
+}
+
+static raw_event read_timer(int fd)
+{
+    uint64_t expirations;
+    if (::read(fd, &expirations, sizeof(expirations)) != sizeof(expirations))
+        return cppevents::empty_event{};
+
+    return pipe_data{fd, 't'};
+}
+
+// eventfd, timerfd, signalfd and inotify descriptors all share one
+// anonymous inode, the number going from one to another is still reuse
+static void anonymous_inode_can_be_added_again()
+{
+    event_queue queue;
+    std::string seen;
+
+    cppevents::on_event<pipe_data>([&](pipe_data& ev) { seen += ev.byte; }, queue);
+
+    const int event_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    CHECK(queue.add_native_source(event_fd, &read_byte) == error_code::success);
+    ::close(event_fd);
+
+    const int timer_fd = ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    CHECK(timer_fd == event_fd);
+    CHECK(queue.add_native_source(timer_fd, &read_timer) == error_code::success);
+
+    itimerspec spec{};
+    spec.it_value.tv_nsec = 1'000'000;
+    timerfd_settime(timer_fd, 0, &spec, nullptr);
+
+    queue.wait(1s);
+    CHECK(seen == "t");
+
+    queue.remove_native_source(timer_fd);
+    ::close(timer_fd);
+}
+
+// closed while a duplicate keeps the file open, the old entry of the
+// descriptor must not keep waking the queue up once the number is reused
+static void duplicated_source_does_not_spin()
+{
+    event_queue queue;
+    std::string seen;
+
+    cppevents::on_event<pipe_data>([&](pipe_data& ev) { seen += ev.byte; }, queue);
+
+    test_pipe closed;
+    const int number = closed.read_end;
+    CHECK(queue.add_native_source(closed.read_end, &read_byte) == error_code::success);
+
+    const int duplicate = ::dup(closed.read_end);
+    ::close(std::exchange(closed.read_end, -1));
+    closed.put("x");
+
+    test_pipe reused;
+    CHECK(reused.read_end == number);
+    CHECK(queue.add_native_source(reused.read_end, &read_byte) == error_code::success);
+
+    const uint64_t polls = queue.statistics().poll_calls;
+    queue.wait(50ms);
+    CHECK(queue.statistics().poll_calls - polls < 10);
+    CHECK(seen.empty());
+
+    reused.put("r");
+    queue.wait(1s);
+    CHECK(seen == "r");
+
+    queue.remove_native_source(reused.read_end);
+    ::close(duplicate);
+}
+
+static void source_removed_by_handler_is_not_dispatched()
+{
+    event_queue queue;
+    test_pipe first;
+    test_pipe second;
+
+    int handled = 0;
+
+    // both are ready in the same batch, whichever goes first removes
+    // the other one
+    cppevents::on_event<pipe_data>([&](pipe_data& ev) {
+        handled++;
+        queue.remove_native_source(ev.fd == first.read_end ? second.read_end : first.read_end);
+    }, queue);
+
+    CHECK(queue.add_native_source(first.read_end, &read_byte) == error_code::success);
+    CHECK(queue.add_native_source(second.read_end, &read_byte) == error_code::success);
+
+    first.put("1");
+    second.put("2");
+
+    queue.wait(1s);
+    queue.poll();
+    CHECK(handled == 1);
+
+    queue.remove_native_source(first.read_end);
+    queue.remove_native_source(second.read_end);
+}
+
+static bool raise_fd_limit(rlim_t fds)
+{
+    rlimit limit{};
+    getrlimit(RLIMIT_NOFILE, &limit);
+
+    if (limit.rlim_cur >= fds)
+        return true;
+
+    limit.rlim_cur = std::min(limit.rlim_max, fds);
+    setrlimit(RLIMIT_NOFILE, &limit);
+
+    return limit.rlim_cur >= fds;
+}
+
+// more sources than fit in the submission ring of io_uring at once, and
+// the descriptors closed right after removing them.  a poll left behind
+// would keep the read end of the pipe open
+static void removed_sources_are_released()
+{
+    constexpr int count = 1500;
+
+    if (not raise_fd_limit(2 * count + 64))
+    {
+        std::cerr << "removed_sources_are_released: skipped, RLIMIT_NOFILE too low\n";
+        return;
+    }
+
+    event_queue queue;
+    std::vector<test_pipe> pipes(count);
+
+    for (test_pipe& pipe : pipes)
+        CHECK(queue.add_native_source(pipe.read_end, &read_byte, nullptr, trigger_mode::edge) == error_code::success);
+
+    queue.poll();
+
+    int released = 0;
+    for (test_pipe& pipe : pipes)
+    {
+        queue.remove_native_source(pipe.read_end);
+        ::close(std::exchange(pipe.read_end, -1));
+
+        if (::write(pipe.write_end, "x", 1) == -1 && errno == EPIPE)
+            released++;
+    }
+
+    CHECK(released == count);
+}
+
+// more level triggered sources ready at once than fit in the submission
+// ring, every one of them has to be polled again after its translator
+static void many_ready_sources_are_polled_again()
+{
+    constexpr int count = 1500;
+
+    if (not raise_fd_limit(2 * count + 64))
+    {
+        std::cerr << "many_ready_sources_are_polled_again: skipped, RLIMIT_NOFILE too low\n";
+        return;
+    }
+
+    event_queue queue;
+    queue.set_batch_size(2 * count);
+
+    int seen = 0;
+    cppevents::on_event<pipe_data>([&](pipe_data&) { seen++; }, queue);
+
+    std::vector<test_pipe> pipes(count);
+    for (test_pipe& pipe : pipes)
+    {
+        CHECK(queue.add_native_source(pipe.read_end, &read_byte) == error_code::success);
+        pipe.put("ab");
+    }
+
+    const auto deadline = std::chrono::steady_clock::now() + 5s;
+    while (seen < 2 * count && std::chrono::steady_clock::now() < deadline)
+        queue.wait(deadline);
+
+    CHECK(seen == 2 * count);
+
+    for (test_pipe& pipe : pipes)
+        queue.remove_native_source(pipe.read_end);
+}
+
+static void timers_fire()
+{
+    event_queue queue;
+    int ticks = 0;
+    bool last = false;
+
+    cppevents::on_event<cppevents::event::timer>([&](cppevents::event::timer& ev) {
+        ticks += ev.expirations;
+        last = ev.last_tick;
+    }, queue);
+
+    CHECK(queue.add_timer(cppevents::timer(7, 2ms, 3)) == error_code::success);
+
+    const auto deadline = std::chrono::steady_clock::now() + 1s;
+    while (not last && std::chrono::steady_clock::now() < deadline)
+        queue.wait(deadline);
+
+    CHECK(ticks == 3);
+    CHECK(last);
+}
+
+static void events_from_other_threads()
+{
+    event_queue queue;
+    int sum = 0;
+
+    cppevents::on_event<remote_event>([&](remote_event& ev) { sum += ev.value; }, queue);
+
+    std::thread sender([&] {
+        for (int i = 1; i <= 100; ++i)
+            queue.send_event(remote_event{i});
+    });
+    sender.join();
+
+    queue.wait(1s);
+    CHECK(sum == 5050);
+}
+
+static cppevents::task read_when_readable(int fd, event_queue& queue, std::string& seen)
+{
+    while (co_await cppevents::readable(fd, queue) == error_code::success)
+    {
+        char buffer[16];
+        ssize_t bytes;
+        while ((bytes = ::read(fd, buffer, sizeof(buffer))) > 0)
+            seen.append(buffer, bytes);
+    }
+}
+
+static void coroutine_awaits_readiness()
+{
+    event_queue queue;
+    test_pipe pipe;
+    std::string seen;
+
+    read_when_readable(pipe.read_end, queue, seen);
+
+    pipe.put("hi");
+    queue.wait(1s);
+    CHECK(seen == "hi");
+
+    pipe.put("!");
+    queue.wait(1s);
+    CHECK(seen == "hi!");
+
+    // a native source cannot take the descriptor from the coroutine
+    CHECK(queue.add_native_source(pipe.read_end, &read_byte) != error_code::success);
+}
+
+int main()
+{
+    signal(SIGPIPE, SIG_IGN);
+
+    level_source_is_polled_again();
+    edge_source_with_batch_translator();
+    live_source_cannot_be_added_twice();
+    removed_source_can_be_added_again();
+    closed_source_can_be_added_again();
+    anonymous_inode_can_be_added_again();
+    duplicated_source_does_not_spin();
+    source_removed_by_handler_is_not_dispatched();
+    removed_sources_are_released();
+    many_ready_sources_are_polled_again();
+    timers_fire();
+    events_from_other_threads();
+    coroutine_awaits_readiness();
+
+    return test::result();
+}
@@ -0,0 +1,32 @@
+// Minimal checks shared by the tests, a failed check is reported and
+// makes the test exit with a failure once it has run to the end
+#ifndef LIBCPPEVENTS_TESTS_CHECK_HPP
+#define LIBCPPEVENTS_TESTS_CHECK_HPP
+
+#include <iostream>
+
+namespace test
+{
+    inline int failures = 0;
+
+    inline bool check(bool passed, const char* expression, const char* file, int line)
+    {
+        if (not passed)
+        {
+            std::cerr << file << ":" << line << ": check failed: " << expression << "\n";
+            failures++;
+        }
+        return passed;
+    }
+
+    inline int result()
+    {
+        if (failures != 0)
+            std::cerr << failures << " checks failed\n";
+        return failures == 0 ? 0 : 1;
+    }
+}
+
+#define CHECK(expression) test::check(static_cast<bool>(expression), #expression, __FILE__, __LINE__)
+
+#endif
@@ -0,0 +1,147 @@
+// Coroutines resumed by events and deadlines, and destroyed along with
+// a queue they are still waiting on
+#include <cppevents/coroutine.hpp>
+#include <cppevents/event_queue.hpp>
+
+#include "check.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+using cppevents::event_queue;
+
+struct message
+{
+    int value;
+};
+
+// counts the frames that went away, finished or destroyed
+struct frame_guard
+{
+    int& gone;
+    ~frame_guard() { gone++; }
+};
+
+static cppevents::task receive(event_queue& queue, std::vector<int>& seen, int count, int& gone)
+{
+    frame_guard guard{gone};
+
+    for (int i = 0; i < count; ++i)
+    {
+        message ev = co_await queue.next<message>();
+        seen.push_back(ev.value);
+    }
+}
+
+static void resumed_by_events()
+{
+    event_queue queue;
+    std::vector<int> first;
+    std::vector<int> second;
+    int handled = 0;
+    int gone = 0;
+
+    cppevents::on_event<message>([&](message&) { handled++; }, queue);
+
+    receive(queue, first, 2, gone);
+    receive(queue, second, 3, gone);
+
+    for (int i = 1; i <= 3; ++i)
+    {
+        queue.post_event(message{i});
+        queue.poll();
+    }
+
+    // every waiter gets each event, and the handler still does
+    CHECK((first == std::vector<int>{1, 2}));
+    CHECK((second == std::vector<int>{1, 2, 3}));
+    CHECK(handled == 3);
+    CHECK(gone == 2);
+}
+
+static cppevents::task sleep_then_record(event_queue& queue, std::chrono::milliseconds duration, std::vector<int>& order, int id)
+{
+    co_await cppevents::sleep_for(duration, queue);
+    order.push_back(id);
+}
+
+static void resumed_by_deadlines_in_order()
+{
+    event_queue queue;
+    std::vector<int> order;
+
+    const auto start = std::chrono::steady_clock::now();
+
+    sleep_then_record(queue, 30ms, order, 3);
+    sleep_then_record(queue, 10ms, order, 1);
+    sleep_then_record(queue, 20ms, order, 2);
+
+    // a deadline in the past does not suspend at all
+    sleep_then_record(queue, -1ms, order, 0);
+    CHECK((order == std::vector<int>{0}));
+
+    const auto deadline = start + 1s;
+    while (order.size() < 4 && std::chrono::steady_clock::now() < deadline)
+        queue.wait(deadline);
+
+    CHECK((order == std::vector<int>{0, 1, 2, 3}));
+    CHECK(std::chrono::steady_clock::now() - start >= 30ms);
+}
+
+static cppevents::task wait_for_message(event_queue& queue, int& gone)
+{
+    frame_guard guard{gone};
+    co_await queue.next<message>();
+}
+
+static cppevents::task wait_for_a_long_time(event_queue& queue, int& gone)
+{
+    frame_guard guard{gone};
+    co_await cppevents::sleep_for(1h, queue);
+}
+
+static cppevents::task wait_until_readable(event_queue& queue, int fd, int& gone)
+{
+    frame_guard guard{gone};
+    co_await cppevents::readable(fd, queue);
+}
+
+// the queue goes first, the frames of everything waiting on it go
+// with it instead of being resumed
+static void destroyed_with_the_queue()
+{
+    int fds[2];
+    CHECK(::pipe2(fds, O_NONBLOCK | O_CLOEXEC) == 0);
+
+    int gone = 0;
+    {
+        event_queue queue;
+
+        wait_for_message(queue, gone);
+        wait_for_message(queue, gone);
+        wait_for_a_long_time(queue, gone);
+        wait_until_readable(queue, fds[0], gone);
+
+        queue.poll();
+        CHECK(gone == 0);
+    }
+
+    CHECK(gone == 4);
+
+    ::close(fds[0]);
+    ::close(fds[1]);
+}
+
+int main()
+{
+    resumed_by_events();
+    resumed_by_deadlines_in_order();
+    destroyed_with_the_queue();
+
+    return test::result();
+}
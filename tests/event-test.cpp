@@ -0,0 +1,169 @@
+// Where raw_event keeps its payload with the inline buffer it was built
+// with, how the payload moves along with the event, and casts out of it
+#include <cppevents/event_queue.hpp>
+
+#include "check.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+
+using cppevents::raw_event;
+
+template <std::size_t Size>
+struct sized
+{
+    unsigned char bytes[Size];
+};
+
+struct alignas(128) over_aligned
+{
+    int value;
+};
+
+// payload address inside the event object or elsewhere
+template <typename T, typename Event>
+static bool is_inside(Event& ev)
+{
+    auto* payload = reinterpret_cast<const std::byte*>(&cppevents::detail::unchecked_event_cast<T>(ev));
+    auto* begin = reinterpret_cast<const std::byte*>(&ev);
+    return payload >= begin && payload + sizeof(T) <= begin + sizeof(Event);
+}
+
+template <typename Event>
+static void placement_follows_inline_size()
+{
+    using fitting = sized<Event::inline_size>;
+    using too_large = sized<Event::inline_size + 1>;
+
+    static_assert(Event::template stored_inline<fitting>);
+    static_assert(not Event::template stored_inline<too_large>);
+    static_assert(not Event::template stored_inline<over_aligned>);
+
+    Event inline_event(fitting{});
+    CHECK(is_inside<fitting>(inline_event));
+
+    Event pooled_event(too_large{});
+    CHECK(not is_inside<too_large>(pooled_event));
+
+    Event aligned_event(over_aligned{5});
+    CHECK(reinterpret_cast<std::uintptr_t>(&cppevents::detail::unchecked_event_cast<over_aligned>(aligned_event)) % 128 == 0);
+    CHECK(cppevents::detail::unchecked_event_cast<over_aligned>(aligned_event).value == 5);
+}
+
+// keeps a pointer to itself, which only stays right when moved with
+// its move constructor
+struct self_pointing
+{
+    self_pointing(int value) : value{value} {}
+    self_pointing(self_pointing&& other) noexcept : value{other.value} { moves++; }
+    ~self_pointing() { destroyed++; }
+
+    bool intact() const { return self == this; }
+
+    self_pointing* self = this;
+    int value;
+
+    static inline int moves = 0;
+    static inline int destroyed = 0;
+};
+
+// not trivially copyable, but moving its bytes is enough
+struct owning
+{
+    std::unique_ptr<int> value;
+};
+
+template <>
+struct cppevents::is_trivially_relocatable<owning> : std::true_type {};
+
+template <typename Event>
+static void payload_moves_with_the_event()
+{
+    static_assert(Event::template stored_inline<self_pointing>);
+    static_assert(Event::template stored_inline<owning>);
+
+    self_pointing::moves = 0;
+    self_pointing::destroyed = 0;
+    {
+        Event first(self_pointing{3});
+        const int moves = self_pointing::moves;
+        const int destroyed = self_pointing::destroyed;
+
+        Event second(std::move(first));
+        CHECK(first.type() == 0);
+        CHECK(second.type() == cppevents::event_type_id<self_pointing>);
+        CHECK(self_pointing::moves == moves + 1);
+        CHECK(self_pointing::destroyed == destroyed + 1);
+
+        auto& moved = cppevents::detail::unchecked_event_cast<self_pointing>(second);
+        CHECK(moved.intact());
+        CHECK(moved.value == 3);
+    }
+    CHECK(self_pointing::moves + 1 == self_pointing::destroyed);
+
+    // relocated as bytes, the pointer stays the same and the moved-from
+    // event owns nothing
+    Event first(owning{std::make_unique<int>(4)});
+    int* value = cppevents::detail::unchecked_event_cast<owning>(first).value.get();
+
+    Event second(std::move(first));
+    CHECK(first.type() == 0);
+    CHECK(cppevents::detail::unchecked_event_cast<owning>(second).value.get() == value);
+
+    Event third(sized<1>{});
+    third = std::move(second);
+    CHECK(second.type() == 0);
+    CHECK(*cppevents::detail::unchecked_event_cast<owning>(third).value == 4);
+}
+
+struct other_event
+{
+    int value;
+};
+
+// casts check the id of the event, the rvalue ones move the payload out
+// and leave the event holding what is left of it
+template <typename Event>
+static void casts_check_the_type()
+{
+    Event ev(owning{std::make_unique<int>(6)});
+
+    CHECK(cppevents::event_ptr<other_event>(ev) == nullptr);
+    CHECK(cppevents::event_ptr<owning>(ev) != nullptr);
+
+    // not of the type, nothing is taken
+    std::optional<other_event> wrong = cppevents::try_event_cast<other_event>(std::move(ev));
+    CHECK(not wrong);
+    CHECK(cppevents::event_ptr<owning>(ev)->value != nullptr);
+
+    std::optional<owning> right = cppevents::try_event_cast<owning>(std::move(ev));
+    CHECK(right && *right->value == 6);
+    CHECK(cppevents::event_ptr<owning>(ev)->value == nullptr);
+
+    Event again(owning{std::make_unique<int>(7)});
+    owning taken = cppevents::event_cast<owning>(std::move(again));
+    CHECK(*taken.value == 7);
+    CHECK(cppevents::event_ptr<owning>(again)->value == nullptr);
+
+    // the lvalue one copies
+    Event plain(other_event{8});
+    CHECK(cppevents::event_cast<other_event>(plain).value == 8);
+    CHECK(cppevents::event_ptr<other_event>(plain)->value == 8);
+}
+
+int main()
+{
+    using wide_event = cppevents::basic_raw_event<64, 64>;
+
+    placement_follows_inline_size<raw_event>();
+    placement_follows_inline_size<wide_event>();
+
+    payload_moves_with_the_event<raw_event>();
+    payload_moves_with_the_event<wide_event>();
+
+    casts_check_the_type<raw_event>();
+    casts_check_the_type<wide_event>();
+
+    return test::result();
+}
@@ -0,0 +1,149 @@
+// Handlers offloaded to the workers of an executor, the order kept for
+// them, tasks stolen between the workers and run before it is destroyed
+#include <cppevents/executor.hpp>
+
+#include "check.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+using namespace std::chrono_literals;
+
+using cppevents::event_queue;
+using cppevents::executor;
+using cppevents::offload;
+using cppevents::offload_order;
+
+struct numbered
+{
+    int value;
+};
+
+struct grouped_events : cppevents::cppevents_group_tag {};
+
+struct grouped
+{
+    using group = grouped_events;
+    int value;
+};
+
+template <typename Predicate>
+static bool wait_for(Predicate done)
+{
+    const auto deadline = std::chrono::steady_clock::now() + 5s;
+    while (not done() && std::chrono::steady_clock::now() < deadline)
+        std::this_thread::sleep_for(1ms);
+    return done();
+}
+
+// events of one binding reach the handler one at a time, in the order
+// they were sent, even with every worker free to take them
+static void ordered_events_stay_in_order()
+{
+    constexpr int count = 2000;
+
+    executor workers(4);
+    event_queue queue;
+
+    std::atomic<int> running = 0;
+    std::atomic<int> handled = 0;
+    std::atomic<bool> in_order = true;
+    std::atomic<bool> alone = true;
+
+    cppevents::on_event<numbered>([&](numbered& ev) {
+        if (running.fetch_add(1) != 0)
+            alone = false;
+        if (ev.value != handled.load())
+            in_order = false;
+        handled.fetch_add(1);
+        running.fetch_sub(1);
+    }, offload{ workers, offload_order::per_type }, queue);
+
+    for (int i = 0; i < count; ++i)
+    {
+        queue.post_event(numbered{i});
+        if (i % 100 == 0)
+            queue.poll();
+    }
+    queue.poll();
+
+    CHECK(wait_for([&] { return handled == count; }));
+    CHECK(in_order);
+    CHECK(alone);
+}
+
+// a worker stuck in a slow task has the tasks dealt to it taken by the
+// others, the slow task only ends once all of them have run
+static void stuck_worker_is_stolen_from()
+{
+    constexpr int count = 20;
+
+    executor workers(2);
+    std::atomic<int> done = 0;
+    std::atomic<bool> released = false;
+
+    workers.submit([&] {
+        released = wait_for([&] { return done == count; });
+    });
+
+    for (int i = 0; i < count; ++i)
+        workers.submit([&] { done++; });
+
+    CHECK(wait_for([&] { return released.load(); }));
+    CHECK(workers.steals() > 0);
+}
+
+// destroying the executor runs what was submitted, also the tasks the
+// tasks submit themselves
+static void destructor_runs_every_task()
+{
+    constexpr int count = 1000;
+    std::atomic<int> done = 0;
+
+    {
+        executor workers(3);
+        for (int i = 0; i < count; ++i)
+        {
+            workers.submit([&workers, &done, i] {
+                if (i % 10 == 0)
+                {
+                    std::this_thread::sleep_for(100us);
+                    workers.submit([&done] { done++; });
+                }
+                done++;
+            });
+        }
+    }
+
+    CHECK(done == count + count / 10);
+}
+
+// the event is moved to the worker, the group handler does not see it
+static void offloaded_events_skip_group_handlers()
+{
+    executor workers(1);
+    event_queue queue;
+
+    std::atomic<int> offloaded = 0;
+    int in_group = 0;
+
+    cppevents::on_event<grouped>([&](grouped& ev) { offloaded += ev.value; }, offload{ workers }, queue);
+    cppevents::on_event<grouped_events>([&](cppevents::raw_event&) { in_group++; }, queue);
+
+    queue.post_event(grouped{1});
+    queue.poll();
+
+    CHECK(wait_for([&] { return offloaded == 1; }));
+    CHECK(in_group == 0);
+}
+
+int main()
+{
+    ordered_events_stay_in_order();
+    stuck_worker_is_stolen_from();
+    destructor_runs_every_task();
+    offloaded_events_skip_group_handlers();
+
+    return test::result();
+}
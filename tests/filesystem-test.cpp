@@ -0,0 +1,233 @@
+// Filesystem watching with inotify, and with fanotify where the process
+// may use it, the watcher falling back to inotify where it may not
+#include <cppevents/filesystem.hpp>
+
+#include "check.hpp"
+
+#include <unistd.h>
+
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <string>
+
+using namespace std::chrono_literals;
+
+using cppevents::error_code;
+using cppevents::event_queue;
+using cppevents::filesystem_backend;
+using cppevents::filesystem_event;
+using cppevents::filesystem_watcher;
+
+namespace fs = std::filesystem;
+
+struct temporary_directory
+{
+    temporary_directory()
+    {
+        char name[] = "/tmp/cppevents-test-XXXXXX";
+        if (::mkdtemp(name) != nullptr)
+            path = fs::canonical(name).native();
+    }
+
+    ~temporary_directory()
+    {
+        std::error_code error;
+        if (not path.empty())
+            fs::remove_all(path, error);
+    }
+
+    std::string path;
+};
+
+// changes merged per path over every wakeup
+struct change_log
+{
+    explicit change_log(event_queue& queue)
+    {
+        cppevents::on_event<filesystem_event>([this](filesystem_event& ev) {
+            changes[ev.path()] |= ev.changes;
+            last_directory = ev.directory;
+            events++;
+        }, queue);
+    }
+
+    bool has(const std::string& path, uint32_t wanted) const
+    {
+        auto it = changes.find(path);
+        return it != changes.end() && (it->second & wanted) == wanted;
+    }
+
+    std::map<std::string, uint32_t> changes;
+    const char* last_directory = nullptr;
+    int events = 0;
+};
+
+template <typename Predicate>
+static bool wait_for(event_queue& queue, Predicate done)
+{
+    const auto deadline = std::chrono::steady_clock::now() + 2s;
+    while (not done() && std::chrono::steady_clock::now() < deadline)
+        queue.wait(50ms);
+    return done();
+}
+
+// whatever is pending, with nothing more expected
+static void settle(event_queue& queue)
+{
+    for (int i = 0; i < 4; ++i)
+        queue.wait(20ms);
+}
+
+static void touch(const std::string& path)
+{
+    std::ofstream(path) << "x";
+}
+
+static const char* name_of(filesystem_backend backend)
+{
+    return backend == filesystem_backend::inotify ? "inotify" : "fanotify";
+}
+
+static void entries_are_reported(filesystem_backend backend)
+{
+    event_queue queue;
+    change_log log(queue);
+    temporary_directory root;
+
+    filesystem_watcher watcher(queue, backend);
+    if (watcher.watch(root.path) != error_code::success)
+    {
+        std::cerr << "entries_are_reported: skipped with " << name_of(watcher.backend()) << ", cannot watch " << root.path << "\n";
+        return;
+    }
+
+    const std::string file = root.path + "/file";
+    const std::string renamed = root.path + "/renamed";
+
+    touch(file);
+    CHECK(wait_for(queue, [&] { return log.has(file, filesystem_event::created); }));
+
+    fs::rename(file, renamed);
+    CHECK(wait_for(queue, [&] { return log.has(file, filesystem_event::moved_from)
+                                    && log.has(renamed, filesystem_event::moved_to); }));
+
+    fs::remove(renamed);
+    CHECK(wait_for(queue, [&] { return log.has(renamed, filesystem_event::deleted); }));
+
+    // directories created later are watched too
+    const std::string sub = root.path + "/sub";
+    fs::create_directory(sub);
+    CHECK(wait_for(queue, [&] { return log.has(sub, filesystem_event::created); }));
+
+    touch(sub + "/inner");
+    CHECK(wait_for(queue, [&] { return log.has(sub + "/inner", filesystem_event::created); }));
+}
+
+// the directory of an event is interned per wakeup, into storage that
+// is reused instead of growing
+static void names_are_reused_between_wakeups(filesystem_backend backend)
+{
+    event_queue queue;
+    change_log log(queue);
+    temporary_directory root;
+
+    filesystem_watcher watcher(queue, backend);
+    if (watcher.watch(root.path) != error_code::success)
+        return;
+
+    touch(root.path + "/first");
+    CHECK(wait_for(queue, [&] { return log.events == 1; }));
+    const char* first = log.last_directory;
+
+    touch(root.path + "/second");
+    CHECK(wait_for(queue, [&] { return log.events == 2; }));
+
+    CHECK(first != nullptr);
+    CHECK(first == log.last_directory);
+}
+
+// unique directories created and deleted do not leave watches behind
+static void deleted_directories_release_their_watches()
+{
+    event_queue queue;
+    change_log log(queue);
+    temporary_directory root;
+
+    filesystem_watcher watcher(queue, filesystem_backend::inotify);
+    CHECK(watcher.watch(root.path) == error_code::success);
+    CHECK(watcher.size() == 1);
+
+    for (int round = 0; round < 10; ++round)
+    {
+        for (int i = 0; i < 20; ++i)
+            fs::create_directory(root.path + "/dir-" + std::to_string(round) + "-" + std::to_string(i));
+        settle(queue);
+
+        for (int i = 0; i < 20; ++i)
+            fs::remove(root.path + "/dir-" + std::to_string(round) + "-" + std::to_string(i));
+        settle(queue);
+    }
+
+    CHECK(wait_for(queue, [&] { return watcher.size() == 1; }));
+}
+
+// a tree moved out stops being watched under its old path, one moved
+// within is watched under the new one
+static void moved_directories_are_followed()
+{
+    event_queue queue;
+    change_log log(queue);
+    temporary_directory root;
+    temporary_directory outside;
+
+    fs::create_directories(root.path + "/a/b");
+    fs::create_directories(root.path + "/c");
+
+    filesystem_watcher watcher(queue, filesystem_backend::inotify);
+    CHECK(watcher.watch(root.path) == error_code::success);
+    CHECK(watcher.size() == 4);
+
+    fs::rename(root.path + "/a", outside.path + "/a");
+    CHECK(wait_for(queue, [&] { return watcher.size() == 2; }));
+
+    touch(outside.path + "/a/b/lost");
+    settle(queue);
+    CHECK(log.changes.count(root.path + "/a/b/lost") == 0);
+
+    fs::rename(root.path + "/c", root.path + "/d");
+    CHECK(wait_for(queue, [&] { return log.has(root.path + "/d", filesystem_event::moved_to); }));
+    CHECK(watcher.size() == 2);
+
+    touch(root.path + "/d/found");
+    CHECK(wait_for(queue, [&] { return log.has(root.path + "/d/found", filesystem_event::created); }));
+    CHECK(log.changes.count(root.path + "/c/found") == 0);
+}
+
+// asked for fanotify, the watcher works either way
+static void fanotify_falls_back()
+{
+    event_queue queue;
+    filesystem_watcher watcher(queue, filesystem_backend::fanotify);
+
+    if (watcher.backend() == filesystem_backend::inotify)
+        std::cerr << "fanotify not available, tested through the fallback\n";
+
+    temporary_directory root;
+    CHECK(watcher.watch(root.path + "/missing") != error_code::success);
+}
+
+int main()
+{
+    for (filesystem_backend backend : {filesystem_backend::inotify, filesystem_backend::fanotify})
+    {
+        entries_are_reported(backend);
+        names_are_reused_between_wakeups(backend);
+    }
+
+    deleted_directories_release_their_watches();
+    moved_directories_are_followed();
+    fanotify_falls_back();
+
+    return test::result();
+}
@@ -0,0 +1,71 @@
+// Sources spread over the shards of a group, and counted while they last
+#include <cppevents/event_queue_group.hpp>
+
+#include "check.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+using cppevents::error_code;
+
+static cppevents::raw_event ignore(int)
+{
+    return cppevents::empty_event{};
+}
+
+static void load_follows_sources()
+{
+    cppevents::event_queue_group group(2, false);
+
+    int fds[2][2];
+    for (auto& fd : fds)
+        CHECK(::pipe2(fd, O_NONBLOCK | O_CLOEXEC) == 0);
+
+    std::size_t chosen[2];
+    for (int i = 0; i < 2; ++i)
+    {
+        CHECK(group.add_native_source(fds[i][0], &ignore, nullptr, cppevents::trigger_mode::level,
+                                      cppevents::shard_policy::least_loaded, 0, &chosen[i]) == error_code::success);
+    }
+
+    CHECK(chosen[0] != chosen[1]);
+    CHECK(group.load(0) == 1);
+    CHECK(group.load(1) == 1);
+
+    group.remove_native_source(fds[0][0]);
+    CHECK(group.load(chosen[0]) == 0);
+    CHECK(group.load(chosen[1]) == 1);
+
+    // removing twice changes nothing
+    group.remove_native_source(fds[0][0]);
+    CHECK(group.load(chosen[0]) == 0);
+
+    group.remove_native_source(fds[1][0]);
+    CHECK(group.load(chosen[1]) == 0);
+
+    for (auto& fd : fds)
+    {
+        ::close(fd[0]);
+        ::close(fd[1]);
+    }
+}
+
+// from the thread of the same shard the function runs right away
+static void run_on_own_shard()
+{
+    cppevents::event_queue_group group(2, false);
+
+    const int value = group.run_on(1, [&] {
+        return group.run_on(1, [] { return 42; });
+    });
+
+    CHECK(value == 42);
+}
+
+int main()
+{
+    load_follows_sources();
+    run_on_own_shard();
+
+    return test::result();
+}
@@ -0,0 +1,126 @@
+// Binding handlers, also from inside a running handler, which grows the
+// table of the queue under the callback being called
+#include <cppevents/event_queue.hpp>
+
+#include "check.hpp"
+
+#include <utility>
+
+using cppevents::error_code;
+using cppevents::event_queue;
+
+template <int N>
+struct numbered_event
+{
+    int value;
+};
+
+struct first_event {};
+
+template <int... N>
+static void bind_numbered(event_queue& queue, int& sum, std::integer_sequence<int, N...>)
+{
+    (cppevents::on_event<numbered_event<N>>([&sum](numbered_event<N>& ev) { sum += ev.value; }, queue), ...);
+}
+
+template <int... N>
+static void send_numbered(event_queue& queue, std::integer_sequence<int, N...>)
+{
+    (queue.send_event(numbered_event<N>{N}), ...);
+}
+
+static void bind_from_handler()
+{
+    event_queue queue;
+    int sum = 0;
+    int calls = 0;
+
+    // state of the running callback, read after the binds below
+    const long tag = 0x5eed;
+
+    cppevents::on_event<first_event>([&queue, &sum, &calls, tag](first_event&) {
+        bind_numbered(queue, sum, std::make_integer_sequence<int, 40>{});
+        calls++;
+        CHECK(tag == 0x5eed);
+    }, queue);
+
+    queue.send_event(first_event{});
+    CHECK(calls == 1);
+
+    send_numbered(queue, std::make_integer_sequence<int, 40>{});
+    CHECK(sum == 39 * 40 / 2);
+
+    // and the first one still works after the table grew
+    queue.send_event(first_event{});
+    CHECK(calls == 2);
+}
+
+static void rebinding_replaces_handler()
+{
+    event_queue queue;
+    int which = 0;
+
+    cppevents::on_event<first_event>([&](first_event&) { which = 1; }, queue);
+    cppevents::on_event<first_event>([&](first_event&) { which = 2; }, queue);
+
+    queue.send_event(first_event{});
+    CHECK(which == 2);
+}
+
+struct counted_event
+{
+    counted_event() = default;
+    counted_event(const counted_event&) { constructed++; }
+    counted_event(counted_event&&) { constructed++; }
+
+    static inline int constructed = 0;
+};
+
+// a handler taking the raw event gets the one in the queue, not the
+// payload converted back into a new raw_event
+static void raw_handlers_get_the_event()
+{
+    event_queue queue;
+    const cppevents::raw_event* seen = nullptr;
+    int calls = 0;
+
+    cppevents::on_event<counted_event>([&](const cppevents::raw_event& ev) {
+        seen = &ev;
+        calls++;
+        CHECK(cppevents::event_ptr<counted_event>(ev) != nullptr);
+    }, queue);
+
+    queue.post_event(counted_event{});
+    const int constructed = counted_event::constructed;
+    queue.poll();
+
+    CHECK(calls == 1);
+    CHECK(seen != nullptr);
+    CHECK(counted_event::constructed == constructed);
+
+    static_assert(cppevents::detail::takes_raw_event<void(*)(const cppevents::raw_event&)>);
+    static_assert(cppevents::detail::takes_raw_event<void(*)(cppevents::raw_event&)>);
+    static_assert(not cppevents::detail::takes_raw_event<void(*)(counted_event&)>);
+}
+
+// a null handler is bound empty, the event is not handled by it
+static void null_handler_is_not_called()
+{
+    event_queue queue;
+
+    void (*no_handler)(first_event&) = nullptr;
+    CHECK(cppevents::on_event<first_event>(no_handler, queue) == error_code::success);
+
+    queue.send_event(first_event{});
+    queue.poll();
+}
+
+int main()
+{
+    bind_from_handler();
+    rebinding_replaces_handler();
+    raw_handlers_get_the_event();
+    null_handler_is_not_called();
+
+    return test::result();
+}
@@ -0,0 +1,122 @@
+// Callables kept in the storage of an inline_function, moved and destroyed
+// with it, and the empty states it can be in
+#include <cppevents/inline_function.hpp>
+
+#include "check.hpp"
+
+#include <utility>
+
+using cppevents::inline_function;
+
+// counts its live copies, moved with its move constructor
+struct tracked
+{
+    tracked(int value) noexcept : value{value} { alive++; }
+    tracked(tracked&& other) noexcept : value{other.value} { alive++; moves++; }
+    ~tracked() { alive--; }
+
+    int operator()(int add) const { return value + add; }
+
+    int value;
+
+    static inline int alive = 0;
+    static inline int moves = 0;
+};
+
+static void moves_and_destroys_the_callable()
+{
+    tracked::alive = 0;
+    tracked::moves = 0;
+
+    {
+        inline_function<int(int)> first(tracked{1});
+        CHECK(tracked::alive == 1);
+        CHECK(first(1) == 2);
+
+        const int moves = tracked::moves;
+        inline_function<int(int)> second(std::move(first));
+        CHECK(tracked::moves == moves + 1);
+        CHECK(tracked::alive == 1);
+        CHECK(not first);
+        CHECK(second(2) == 3);
+
+        // the callable replaced by the assignment goes away
+        inline_function<int(int)> third(tracked{10});
+        CHECK(tracked::alive == 2);
+        third = std::move(second);
+        CHECK(tracked::alive == 1);
+        CHECK(third(0) == 1);
+
+        third = nullptr;
+        CHECK(tracked::alive == 0);
+        CHECK(not third);
+
+        inline_function<int(int)> last(tracked{5});
+        CHECK(tracked::alive == 1);
+    }
+
+    CHECK(tracked::alive == 0);
+}
+
+// trivially copyable callables are moved as bytes
+static void trivial_callables_are_copied()
+{
+    int calls = 0;
+    inline_function<void()> first([&calls] { calls++; });
+    inline_function<void()> second(std::move(first));
+
+    CHECK(not first);
+    second();
+    CHECK(calls == 1);
+}
+
+// a callable of exactly the capacity fits, and keeps all of its bytes
+static void capture_at_capacity()
+{
+    struct full
+    {
+        unsigned char bytes[32];
+        int operator()() const { return bytes[0] + bytes[31]; }
+    };
+
+    using function_type = inline_function<int(), sizeof(full), alignof(full)>;
+
+    full callable{};
+    callable.bytes[0] = 1;
+    callable.bytes[31] = 2;
+
+    function_type first(callable);
+    function_type second(std::move(first));
+
+    CHECK(function_type::capacity() == sizeof(full));
+    CHECK(second() == 3);
+}
+
+static int plus_one(int value) { return value + 1; }
+
+// never holding a callable, the function is empty
+static void empty_functions()
+{
+    inline_function<int(int)> defaulted;
+    inline_function<int(int)> null(nullptr);
+    CHECK(not defaulted);
+    CHECK(not null);
+
+    int (*no_function)(int) = nullptr;
+    inline_function<int(int)> from_null_pointer(no_function);
+    CHECK(not from_null_pointer);
+
+    inline_function<int(int)> from_pointer(&plus_one);
+    CHECK(from_pointer);
+    CHECK(from_pointer(1) == 2);
+}
+
+int main()
+{
+    moves_and_destroys_the_callable();
+    trivial_callables_are_copied();
+    capture_at_capacity();
+    empty_functions();
+
+    return test::result();
+}
@@ -0,0 +1,169 @@
+// Listening and connected sockets added as sources
+#include <cppevents/event_queue.hpp>
+#include <cppevents/network.hpp>
+
+#include "check.hpp"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+using cppevents::error_code;
+using cppevents::event_queue;
+using cppevents::network_event;
+
+static int listen_on_loopback(sockaddr_in& address)
+{
+    int sock = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+    address = sockaddr_in{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    socklen_t length = sizeof(address);
+    if (::bind(sock, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == -1
+        || ::listen(sock, 16) == -1
+        || ::getsockname(sock, reinterpret_cast<sockaddr*>(&address), &length) == -1)
+    {
+        ::close(sock);
+        return -1;
+    }
+
+    return sock;
+}
+
+static int connect_to(const sockaddr_in& address)
+{
+    int sock = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (::connect(sock, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == -1)
+    {
+        ::close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+// out of descriptors, the pending connections are dropped and reported
+// instead of leaving the listener readable for the queue to spin on
+static void accept_without_descriptors()
+{
+    sockaddr_in address;
+    const int listener = listen_on_loopback(address);
+    CHECK(listener != -1);
+
+    event_queue queue;
+    int accepted = 0;
+    int failures = 0;
+    int error = 0;
+
+    cppevents::on_event<network_event>([&](network_event& ev) {
+        if (ev.type == network_event::new_connection)
+        {
+            accepted++;
+            ::close(ev.sock_handle);
+        }
+        else if (ev.type == network_event::accept_failed)
+        {
+            failures++;
+            error = ev.error;
+        }
+    }, queue);
+
+    CHECK(cppevents::add_source<cppevents::socket_listener>(listener, queue) == error_code::success);
+
+    std::vector<int> clients;
+    for (int i = 0; i < 3; ++i)
+        clients.push_back(connect_to(address));
+
+    // the lowest free descriptor is the first one over the limit
+    rlimit limit{};
+    getrlimit(RLIMIT_NOFILE, &limit);
+
+    const int lowest_free = ::dup(0);
+    ::close(lowest_free);
+
+    rlimit lowered = limit;
+    lowered.rlim_cur = lowest_free;
+    CHECK(setrlimit(RLIMIT_NOFILE, &lowered) == 0);
+
+    queue.wait(1s);
+
+    const uint64_t polls = queue.statistics().poll_calls;
+    queue.wait(50ms);
+    const uint64_t idle_polls = queue.statistics().poll_calls - polls;
+
+    setrlimit(RLIMIT_NOFILE, &limit);
+
+    CHECK(accepted == 0);
+    CHECK(failures == 1);
+    CHECK(error == EMFILE);
+    CHECK(idle_polls < 5);
+
+    // every client was hung up on
+    for (int client : clients)
+    {
+        char byte;
+        const ssize_t bytes = ::read(client, &byte, 1);
+        CHECK(bytes == 0 || (bytes == -1 && errno == ECONNRESET));
+        ::close(client);
+    }
+
+    // and the listener works again once there is room
+    const int client = connect_to(address);
+    queue.wait(1s);
+    CHECK(accepted == 1);
+
+    ::close(client);
+    queue.remove_native_source(listener);
+    ::close(listener);
+}
+
+static void data_is_received()
+{
+    event_queue queue;
+    int fds[2];
+    CHECK(::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == 0);
+
+    std::string seen;
+    bool closed = false;
+
+    cppevents::on_event<network_event>([&](network_event& ev) {
+        if (ev.type == network_event::data_received)
+            seen.append(reinterpret_cast<const char*>(ev.data.data()), ev.data.size());
+        else if (ev.type == network_event::connection_closed)
+            closed = true;
+    }, queue);
+
+    CHECK(cppevents::add_source<cppevents::socket_io_event>(fds[0], queue) == error_code::success);
+
+    CHECK(::write(fds[1], "ping", 4) == 4);
+    queue.wait(1s);
+    CHECK(seen == "ping");
+
+    ::close(fds[1]);
+    queue.wait(1s);
+    CHECK(closed);
+
+    queue.remove_native_source(fds[0]);
+    ::close(fds[0]);
+}
+
+int main()
+{
+    signal(SIGPIPE, SIG_IGN);
+
+    data_is_received();
+    accept_without_descriptors();
+
+    return test::result();
+}
@@ -0,0 +1,147 @@
+// Events, receive buffers and coroutine frames from the pool of a queue,
+// which only serves the thread while it runs the queue and may go away
+// before the blocks taken from it
+#include <cppevents/buffer_pool.hpp>
+#include <cppevents/coroutine.hpp>
+#include <cppevents/event_queue.hpp>
+
+#include "check.hpp"
+
+#include <cstring>
+#include <optional>
+#include <thread>
+
+using cppevents::event_queue;
+
+// too large for the inline buffer of raw_event
+struct big_event
+{
+    int value;
+    char padding[200];
+};
+
+struct trigger
+{
+    int value;
+};
+
+// the repro from the review: creating a queue used to make its pool the
+// current one, and destroying it freed the block of the posted event
+static void other_queue_does_not_take_events()
+{
+    event_queue queue;
+    int seen = 0;
+
+    cppevents::on_event<big_event>([&](big_event& ev) { seen += ev.value; }, queue);
+
+    {
+        event_queue worker;
+        queue.post_event(big_event{7, {}});
+    }
+
+    queue.poll();
+    CHECK(seen == 7);
+}
+
+// posted from a handler of one queue to another, the event comes from
+// the pool of the first and is freed after that queue is gone
+static void event_outlives_its_queue()
+{
+    event_queue receiver;
+    int seen = 0;
+
+    cppevents::on_event<big_event>([&](big_event& ev) { seen += ev.value; }, receiver);
+
+    {
+        event_queue sender;
+        cppevents::on_event<trigger>([&](trigger& ev) { receiver.post_event(big_event{ev.value, {}}); }, sender);
+
+        sender.post_event(trigger{3});
+        sender.poll();
+
+        CHECK(sender.statistics().pool_allocations == 1);
+    }
+
+    receiver.poll();
+    CHECK(seen == 3);
+}
+
+// a handler running another queue gets its own pool back afterwards
+static void nested_poll_restores_the_pool()
+{
+    event_queue outer;
+    event_queue inner;
+
+    cppevents::on_event<trigger>([&](trigger&) {
+        inner.poll();
+        outer.post_event(big_event{1, {}});
+    }, outer);
+    cppevents::on_event<big_event>([](big_event&) {}, outer);
+
+    outer.post_event(trigger{0});
+    outer.poll();
+    outer.poll();
+
+    CHECK(outer.statistics().pool_allocations == 1);
+    CHECK(inner.statistics().pool_allocations == 0);
+}
+
+static void buffer_outlives_its_queue()
+{
+    std::optional<cppevents::buffer_lease> kept;
+
+    {
+        event_queue queue;
+        cppevents::on_event<trigger>([&](trigger&) {
+            kept = cppevents::buffer_lease::acquire();
+            std::memset(kept->data(), 'x', cppevents::buffer_lease::capacity);
+        }, queue);
+
+        queue.post_event(trigger{0});
+        queue.poll();
+
+        CHECK(queue.statistics().buffer_allocations == 1);
+    }
+
+    // the last block of the abandoned pool, returned from another thread
+    std::thread([&] { kept.reset(); }).join();
+}
+
+static cppevents::task wait_for_trigger(event_queue& queue, int& seen)
+{
+    trigger ev = co_await queue.next<trigger>();
+    seen = ev.value;
+}
+
+// started from a handler, so the frame comes from the pool of the queue
+// running it, and is freed when it finishes on another queue
+static void frame_outlives_its_queue()
+{
+    event_queue waited_on;
+    int seen = 0;
+
+    {
+        event_queue starter;
+        cppevents::on_event<big_event>([&](big_event&) { wait_for_trigger(waited_on, seen); }, starter);
+
+        starter.post_event(big_event{0, {}});
+        starter.poll();
+
+        CHECK(starter.statistics().pool_allocations == 1);
+    }
+
+    waited_on.post_event(trigger{5});
+    waited_on.poll();
+    CHECK(seen == 5);
+}
+
+int main()
+{
+    other_queue_does_not_take_events();
+    event_outlives_its_queue();
+    nested_poll_restores_the_pool();
+    buffer_outlives_its_queue();
+    frame_outlives_its_queue();
+
+    return test::result();
+}
@@ -0,0 +1,108 @@
+// Events posted from the queue thread are deferred to the next wait or
+// poll and handled in the order they were posted
+#include <cppevents/event_queue.hpp>
+
+#include "check.hpp"
+
+#include <chrono>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+using cppevents::event_queue;
+
+struct numbered
+{
+    int value;
+};
+
+struct followup
+{
+    int value;
+};
+
+static void posted_events_keep_their_order()
+{
+    event_queue queue;
+    std::vector<int> seen;
+
+    cppevents::on_event<numbered>([&](numbered& ev) { seen.push_back(ev.value); }, queue);
+
+    for (int i = 0; i < 100; ++i)
+        queue.post_event(numbered{i});
+
+    // nothing is handled from post_event itself
+    CHECK(seen.empty());
+
+    queue.poll();
+
+    CHECK(seen.size() == 100);
+    for (int i = 0; i < static_cast<int>(seen.size()); ++i)
+        CHECK(seen[i] == i);
+}
+
+// a handler posting more events does not recurse, they wait a round
+static void events_posted_by_handlers_wait_a_round()
+{
+    event_queue queue;
+    std::vector<int> seen;
+
+    cppevents::on_event<numbered>([&](numbered& ev) {
+        seen.push_back(ev.value);
+        queue.post_event(followup{ev.value + 10});
+    }, queue);
+    cppevents::on_event<followup>([&](followup& ev) { seen.push_back(ev.value); }, queue);
+
+    queue.post_event(numbered{1});
+    queue.post_event(numbered{2});
+
+    queue.poll();
+    CHECK((seen == std::vector<int>{1, 2}));
+
+    queue.poll();
+    CHECK((seen == std::vector<int>{1, 2, 11, 12}));
+}
+
+// send_event on the queue thread is handled right away, ahead of
+// anything still posted
+static void sent_events_go_ahead_of_posted()
+{
+    event_queue queue;
+    std::vector<int> seen;
+
+    cppevents::on_event<numbered>([&](numbered& ev) { seen.push_back(ev.value); }, queue);
+
+    queue.post_event(numbered{1});
+    queue.send_event(numbered{2});
+    CHECK((seen == std::vector<int>{2}));
+
+    queue.poll();
+    CHECK((seen == std::vector<int>{2, 1}));
+}
+
+// posted events count as received, wait does not block on them
+static void wait_returns_for_posted_events()
+{
+    event_queue queue;
+    int seen = 0;
+
+    cppevents::on_event<numbered>([&](numbered&) { seen++; }, queue);
+
+    queue.post_event(numbered{0});
+
+    const auto start = std::chrono::steady_clock::now();
+    queue.wait(10s);
+
+    CHECK(seen == 1);
+    CHECK(std::chrono::steady_clock::now() - start < 1s);
+}
+
+int main()
+{
+    posted_events_keep_their_order();
+    events_posted_by_handlers_wait_a_round();
+    sent_events_go_ahead_of_posted();
+    wait_returns_for_posted_events();
+
+    return test::result();
+}
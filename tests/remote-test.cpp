@@ -0,0 +1,139 @@
+// Events sent from other threads go through the lock-free inbox, and
+// only the sender finding it empty wakes the queue up
+#include <cppevents/event_queue.hpp>
+
+#include "check.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+using cppevents::event_queue;
+
+struct from_thread
+{
+    int sender;
+    int sequence;
+};
+
+// everything sent while the queue is busy rides on a single wakeup
+static void sends_share_one_wakeup()
+{
+    event_queue queue;
+    std::vector<int> seen;
+
+    cppevents::on_event<from_thread>([&](from_thread& ev) { seen.push_back(ev.sequence); }, queue);
+
+    std::thread sender([&] {
+        for (int i = 0; i < 1000; ++i)
+            queue.send_event(from_thread{0, i});
+    });
+    sender.join();
+
+    queue.wait(1s);
+
+    const cppevents::queue_statistics stats = queue.statistics();
+    CHECK(stats.remote_wakeups == 1);
+    CHECK(stats.remote_events == 1000);
+
+    CHECK(seen.size() == 1000);
+    for (int i = 0; i < static_cast<int>(seen.size()); ++i)
+        CHECK(seen[i] == i);
+
+    // the next send after the inbox was taken wakes it up again
+    std::thread([&] { queue.send_event(from_thread{0, 1000}); }).join();
+    queue.wait(1s);
+
+    CHECK(queue.statistics().remote_wakeups == 2);
+    CHECK(seen.size() == 1001);
+}
+
+// several senders at once, each one keeps its own order
+static void concurrent_senders_keep_their_order()
+{
+    constexpr int senders = 4;
+    constexpr int per_sender = 5000;
+
+    event_queue queue;
+    std::vector<int> next(senders, 0);
+    int out_of_order = 0;
+    int received = 0;
+
+    cppevents::on_event<from_thread>([&](from_thread& ev) {
+        if (ev.sequence != next[ev.sender])
+            out_of_order++;
+        next[ev.sender] = ev.sequence + 1;
+        received++;
+    }, queue);
+
+    std::vector<std::thread> threads;
+    for (int s = 0; s < senders; ++s)
+    {
+        threads.emplace_back([&queue, s] {
+            for (int i = 0; i < per_sender; ++i)
+                queue.send_event(from_thread{s, i});
+        });
+    }
+
+    const auto deadline = std::chrono::steady_clock::now() + 10s;
+    while (received < senders * per_sender && std::chrono::steady_clock::now() < deadline)
+        queue.wait(deadline);
+
+    for (std::thread& thread : threads)
+        thread.join();
+
+    CHECK(received == senders * per_sender);
+    CHECK(out_of_order == 0);
+    CHECK(queue.statistics().remote_wakeups <= queue.statistics().remote_events);
+}
+
+// a queue blocked in wait is woken by a send, and execute runs there
+static void blocked_queue_is_woken()
+{
+    event_queue queue;
+    std::atomic<bool> started = false;
+    std::atomic<bool> handled = false;
+    std::atomic<bool> ran_on_queue = false;
+    std::thread::id queue_thread;
+
+    cppevents::on_event<from_thread>([&](from_thread&) { handled = true; }, queue);
+
+    std::thread runner([&] {
+        queue_thread = std::this_thread::get_id();
+
+        // the queue belongs to the thread that last ran it
+        queue.poll();
+        started = true;
+
+        const auto deadline = std::chrono::steady_clock::now() + 5s;
+        while (not (handled && ran_on_queue) && std::chrono::steady_clock::now() < deadline)
+            queue.wait(deadline);
+    });
+
+    // give the runner time to block
+    while (not started)
+        std::this_thread::yield();
+    std::this_thread::sleep_for(50ms);
+
+    const auto start = std::chrono::steady_clock::now();
+    queue.send_event(from_thread{0, 0});
+    queue.execute([&] { ran_on_queue = std::this_thread::get_id() == queue_thread; });
+
+    runner.join();
+
+    CHECK(handled);
+    CHECK(ran_on_queue);
+    CHECK(std::chrono::steady_clock::now() - start < 1s);
+}
+
+int main()
+{
+    sends_share_one_wakeup();
+    concurrent_senders_keep_their_order();
+    blocked_queue_is_woken();
+
+    return test::result();
+}
@@ -0,0 +1,117 @@
+// Signals read from the signalfd of a queue, every pending one in the
+// same wakeup, and given back to the process when removed
+#include <cppevents/event_queue.hpp>
+#include <cppevents/signal.hpp>
+
+#include "check.hpp"
+
+#include <signal.h>
+#include <unistd.h>
+
+#include <vector>
+
+using namespace std::chrono_literals;
+
+using cppevents::error_code;
+using cppevents::event_queue;
+
+static bool is_blocked(int signal)
+{
+    sigset_t current;
+    pthread_sigmask(SIG_BLOCK, nullptr, &current);
+    return sigismember(&current, signal) == 1;
+}
+
+// more queued signals than the signalfd hands out in one read, and
+// standard ones next to them, all handled by a single wait
+static void pending_signals_share_one_wakeup()
+{
+    constexpr int queued = 150;
+
+    event_queue queue;
+    std::vector<int> seen;
+    int from_us = 0;
+
+    cppevents::on_event<cppevents::event::signal>([&](cppevents::event::signal& ev) {
+        seen.push_back(ev.signal_no);
+        if (ev.sender_pid == getpid())
+            from_us++;
+    }, queue);
+
+    CHECK(queue.add_signal(SIGUSR1) == error_code::success);
+    CHECK(queue.add_signal(SIGUSR2) == error_code::success);
+    CHECK(queue.add_signal(SIGRTMIN) == error_code::success);
+    CHECK(queue.add_signal(SIGUSR1) == error_code::already_exists);
+
+    CHECK(is_blocked(SIGUSR1));
+    CHECK(is_blocked(SIGRTMIN));
+
+    // realtime signals queue up, one record each
+    for (int i = 0; i < queued; ++i)
+        sigqueue(getpid(), SIGRTMIN, sigval{ .sival_int = i });
+    kill(getpid(), SIGUSR1);
+    kill(getpid(), SIGUSR2);
+
+    const uint64_t polls = queue.statistics().poll_calls;
+    queue.wait(1s);
+
+    CHECK(queue.statistics().poll_calls == polls + 1);
+    CHECK(seen.size() == queued + 2);
+    CHECK(from_us == queued + 2);
+
+    int realtime = 0;
+    for (int signal : seen)
+        if (signal == SIGRTMIN)
+            realtime++;
+    CHECK(realtime == queued);
+
+    CHECK(queue.remove_signal(SIGUSR1));
+    CHECK(queue.remove_signal(SIGUSR2));
+    CHECK(queue.remove_signal(SIGRTMIN));
+}
+
+static volatile sig_atomic_t handled_by_process = 0;
+
+// a removed signal goes back to its handler, the queue no longer sees it,
+// and a signal that was blocked before adding it stays blocked
+static void removed_signal_goes_back_to_the_process()
+{
+    event_queue queue;
+    int seen = 0;
+
+    cppevents::on_event<cppevents::event::signal>([&](cppevents::event::signal&) { seen++; }, queue);
+
+    signal(SIGUSR2, [](int) { handled_by_process = 1; });
+
+    sigset_t already;
+    sigemptyset(&already);
+    sigaddset(&already, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &already, nullptr);
+
+    CHECK(queue.add_signal(SIGUSR1) == error_code::success);
+    CHECK(queue.add_signal(SIGUSR2) == error_code::success);
+
+    CHECK(queue.remove_signal(SIGUSR1));
+    CHECK(queue.remove_signal(SIGUSR2));
+    CHECK(not queue.remove_signal(SIGUSR2));
+
+    CHECK(is_blocked(SIGUSR1));
+    CHECK(not is_blocked(SIGUSR2));
+
+    raise(SIGUSR2);
+    queue.wait(10ms);
+
+    CHECK(handled_by_process == 1);
+    CHECK(seen == 0);
+
+    pthread_sigmask(SIG_UNBLOCK, &already, nullptr);
+    signal(SIGUSR2, SIG_DFL);
+}
+
+int main()
+{
+    pending_signals_share_one_wakeup();
+    removed_signal_goes_back_to_the_process();
+
+    return test::result();
+}
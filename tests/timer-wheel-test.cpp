@@ -0,0 +1,161 @@
+// The timing wheel on its own, driven by the time points it asks to be
+// woken at instead of a real clock
+#include "timer_wheel.hpp"
+
+#include "check.hpp"
+
+#include <iostream>
+#include <map>
+
+using namespace std::chrono_literals;
+
+using cppevents::detail::timer_wheel;
+using clock_type = timer_wheel::clock;
+
+// distances on both sides of the slot boundaries of every wheel, and
+// one far enough for the overflow list
+static const std::chrono::milliseconds distances[] = {
+    1ms, 255ms, 256ms, 257ms,
+    65535ms, 65536ms, 65537ms, 70000ms,
+    16777215ms, 16777216ms, 16777217ms,
+    4294967295ms, 4294967296ms, 4294967297ms,
+    5000000000ms,
+};
+
+// follows next_wakeup until every timer has fired, and checks that none
+// fires early, late, or wakes the wheel up for nothing too often
+static void timers_across_levels_fire_on_time()
+{
+    timer_wheel wheel;
+
+    const clock_type::time_point before = clock_type::now();
+    int id = 0;
+    for (std::chrono::milliseconds distance : distances)
+        wheel.schedule(++id, distance, 1s, 1);
+    const clock_type::time_point after = clock_type::now();
+
+    std::map<int, clock_type::time_point> fired;
+    clock_type::time_point now = after;
+    int wakeups = 0;
+
+    while (wheel.size() != 0 && wakeups < 1000)
+    {
+        const auto next = wheel.next_wakeup();
+        CHECK(next.has_value());
+        CHECK(*next != clock_type::time_point::max());
+        // only the first may be due already, when the wheel starts on
+        // a block boundary
+        CHECK(*next >= now || wakeups == 0);
+
+        now = std::max(now, *next);
+        wheel.advance(now, [&](const timer_wheel::expiry& ev) {
+            CHECK(ev.last_tick);
+            fired[ev.timer_id] = now;
+        });
+        wakeups++;
+    }
+
+    CHECK(wheel.size() == 0);
+    CHECK(not wheel.next_wakeup().has_value());
+    CHECK(wakeups < 100);
+
+    id = 0;
+    for (std::chrono::milliseconds distance : distances)
+    {
+        CHECK(fired.count(++id) == 1);
+        CHECK(fired[id] >= before + distance);
+        CHECK(fired[id] <= after + distance + 2ms);
+    }
+}
+
+// inside a block of the second wheel, a timer landing in the slot of
+// that block is a whole turn away, and the wakeup has to find it
+static void timer_a_turn_away_is_found()
+{
+    timer_wheel wheel;
+
+    const clock_type::time_point start = clock_type::now();
+
+    // keeps the wheel from starting over when it runs empty
+    wheel.schedule(1, 24h, 1s, 1);
+    wheel.schedule(2, 20ms, 1s, 1);
+
+    int fired = 0;
+    wheel.advance(start + 30ms, [&](const timer_wheel::expiry&) { fired++; });
+    CHECK(fired == 1);
+
+    wheel.schedule(3, 65540ms, 1s, 1);
+    const clock_type::time_point scheduled = clock_type::now();
+
+    const auto next = wheel.next_wakeup();
+    CHECK(next.has_value());
+    CHECK(*next > start + 30ms);
+    CHECK(*next <= scheduled + 65540ms + 1ms);
+
+    fired = 0;
+    wheel.advance(scheduled + 65540ms + 2ms, [&](const timer_wheel::expiry& ev) {
+        CHECK(ev.timer_id == 3);
+        fired++;
+    });
+    CHECK(fired == 1);
+}
+
+static void single_timer_below_a_level_boundary()
+{
+    timer_wheel wheel;
+
+    const clock_type::time_point start = clock_type::now();
+    wheel.schedule(1, 65534ms, 1s, 1);
+
+    const auto next = wheel.next_wakeup();
+    CHECK(next.has_value());
+    CHECK(*next >= start);
+    CHECK(*next <= clock_type::now() + 65534ms + 1ms);
+}
+
+// windows [5, 6] and [6, 7] align to ticks 6 and 7, the first tick
+// to fire is in both and takes the two timers along
+static void overlapping_windows_share_a_wakeup()
+{
+    for (int attempt = 0; attempt < 10; ++attempt)
+    {
+        timer_wheel wheel;
+        const clock_type::time_point start = clock_type::now();
+
+        // ticks are counted from the creation of the wheel and rounded
+        // up, so these are due on ticks 5 and 6 unless a millisecond went
+        // by in between
+        wheel.schedule(1, 4ms, 1s, 1, 1ms);
+        wheel.schedule(2, 5ms, 1s, 1, 1ms);
+        if (clock_type::now() - start >= 500us)
+            continue;
+
+        int wakeups = 0;
+        int fired = 0;
+        while (wheel.size() != 0 && wakeups < 10)
+        {
+            const auto next = wheel.next_wakeup();
+            CHECK(next.has_value());
+
+            wheel.advance(*next, [&](const timer_wheel::expiry&) { fired++; });
+            wakeups++;
+        }
+
+        CHECK(fired == 2);
+        CHECK(wakeups == 1);
+        CHECK(wheel.coalesced() == 1);
+        return;
+    }
+
+    std::cerr << "overlapping_windows_share_a_wakeup: skipped, the clock kept moving on\n";
+}
+
+int main()
+{
+    timers_across_levels_fire_on_time();
+    timer_a_turn_away_is_found();
+    single_timer_below_a_level_boundary();
+    overlapping_windows_share_a_wakeup();
+
+    return test::result();
+}
@@ -0,0 +1,115 @@
+// Deadlines and timeouts given to wait(), at the ends of their range and
+// below the millisecond epoll_wait would round them to
+#include <cppevents/event_queue.hpp>
+
+#include "check.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <thread>
+
+using namespace std::chrono_literals;
+
+using cppevents::event_queue;
+using clock_type = std::chrono::steady_clock;
+
+struct wake_up
+{
+    int value;
+};
+
+// none of these may block, with or without anything to handle
+static void expired_waits_return_at_once()
+{
+    event_queue queue;
+    int seen = 0;
+
+    cppevents::on_event<wake_up>([&](wake_up& ev) { seen += ev.value; }, queue);
+
+    const clock_type::time_point start = clock_type::now();
+
+    queue.wait(0s);
+    queue.wait(0ns);
+    queue.wait(clock_type::now());
+    queue.wait(clock_type::now() - 1h);
+    queue.wait(clock_type::time_point{});
+    queue.wait(clock_type::time_point::min());
+
+    CHECK(clock_type::now() - start < 500ms);
+
+    // what is already there is still handled
+    std::thread([&] { queue.send_event(wake_up{1}); }).join();
+    queue.wait(clock_type::time_point::min());
+    CHECK(seen == 1);
+}
+
+// a timeout below a millisecond is neither skipped nor rounded to zero
+static void short_timeouts_are_kept()
+{
+    event_queue queue;
+
+    for (std::chrono::microseconds timeout : {1us, 200us, 999us, 1500us})
+    {
+        const clock_type::time_point start = clock_type::now();
+        queue.wait(timeout);
+        const clock_type::duration waited = clock_type::now() - start;
+
+        CHECK(waited >= timeout);
+        CHECK(waited < 500ms);
+    }
+}
+
+// the wait is started on a thread of its own and must still be blocked
+// when the event is sent, then return with it handled
+static void blocks_until_woken(const std::function<void(event_queue&)>& wait)
+{
+    event_queue queue;
+    std::atomic<bool> started = false;
+    std::atomic<bool> returned = false;
+    std::atomic<int> seen = 0;
+
+    cppevents::on_event<wake_up>([&](wake_up& ev) { seen = ev.value; }, queue);
+
+    std::thread runner([&] {
+        // the queue belongs to the thread that last ran it
+        queue.poll();
+        started = true;
+
+        wait(queue);
+        returned = true;
+    });
+
+    while (not started)
+        std::this_thread::yield();
+    std::this_thread::sleep_for(50ms);
+
+    CHECK(not returned);
+
+    queue.send_event(wake_up{1});
+    runner.join();
+
+    CHECK(seen == 1);
+}
+
+// negative timeouts and those past the end of the clock mean no limit,
+// the deadline saturates instead of wrapping around into the past
+static void unlimited_waits_block()
+{
+    blocks_until_woken([](event_queue& queue) { queue.wait(-1ns); });
+    blocks_until_woken([](event_queue& queue) { queue.wait(-24h); });
+    blocks_until_woken([](event_queue& queue) { queue.wait(clock_type::duration::min()); });
+    blocks_until_woken([](event_queue& queue) { queue.wait(clock_type::duration::max()); });
+    blocks_until_woken([](event_queue& queue) { queue.wait(std::chrono::hours::max()); });
+    blocks_until_woken([](event_queue& queue) { queue.wait(std::chrono::duration<double>(1e300)); });
+    blocks_until_woken([](event_queue& queue) { queue.wait(clock_type::time_point::max()); });
+}
+
+int main()
+{
+    expired_waits_return_at_once();
+    short_timeouts_are_kept();
+    unlimited_waits_block();
+
+    return test::result();
+}